@@ -0,0 +1,154 @@
+/************************************************************************
+* Allocation check for the time loop of FEMSolver::solve().
+* Every configuration is solved twice: the first call builds the cached
+* factorizations and workspaces, the second must not allocate at all.
+* Heap use is caught two ways: global operator new is replaced by a
+* counting version (std::vector, std::function, ...), and Eigen's own
+* allocations assert under -DEIGEN_RUNTIME_NO_MALLOC. Exits non-zero if
+* any configuration allocates. EnsembleDiffusionSolver is covered too.
+* Two paths are excluded because they allocate by design: the dense QR
+* backend (verification only; solve() lifts the no-malloc guard for it,
+* since Eigen's QR solve returns a new vector), and h-adaptive remeshing
+* (set_mesh_adaptation), whose remesh events change the node count and
+* rebuild M, its factorization and every workspace.
+*
+*   g++ -O1 -pthread -DEIGEN_RUNTIME_NO_MALLOC -I/usr/include/eigen3 \
+*       alloc_check.cpp -o alloc_check -ldl && ./alloc_check
+************************************************************************/
+#ifndef EIGEN_RUNTIME_NO_MALLOC
+#error "build alloc_check with -DEIGEN_RUNTIME_NO_MALLOC"
+#endif
+#ifdef NDEBUG
+#error "build alloc_check without -DNDEBUG: Eigen reports allocations through assertions"
+#endif
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <functional>
+#include <string>
+
+static std::atomic<bool> counting{false};     // Count allocations while true
+static std::atomic<long> allocations{0};      // Allocations seen while counting
+
+void* operator new(std::size_t size) {
+    if (counting.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#define FEM_NO_MAIN
+#include "main.cpp"
+
+// Logistic reaction term, to cover the source path
+static void logistic(void*, const double*, const double* u, double* f, double* df_du, int n) {
+    for (int i = 0; i < n; ++i) {
+        f[i] = u[i] * (1.0 - u[i]);
+        if (df_du) df_du[i] = 1.0 - 2.0 * u[i];
+    }
+}
+
+// Solve once to warm up, then again with every allocation counted (and Eigen's forbidden)
+template <class Solver>
+static bool check(const string& name, Solver& solver) {
+    solver.solve();
+    cout << name << " ... " << flush;
+    allocations = 0;
+    counting = true;
+    internal::set_is_malloc_allowed(false);
+    solver.solve();
+    internal::set_is_malloc_allowed(true);
+    counting = false;
+    if (allocations != 0) {
+        cout << allocations << " allocation(s)" << endl;
+        return false;
+    }
+    cout << "ok" << endl;
+    return true;
+}
+
+int main() {
+    const TimeIntegrator integrators[] = {TimeIntegrator::ForwardEuler, TimeIntegrator::BackwardEuler,
+                                          TimeIntegrator::CrankNicolson, TimeIntegrator::Theta,
+                                          TimeIntegrator::RKC};
+    const char* integrator_names[] = {"forward Euler", "backward Euler", "Crank-Nicolson", "theta", "RKC"};
+    const LinearSolverBackend backends[] = {LinearSolverBackend::Thomas, LinearSolverBackend::Partitioned};
+    const char* backend_names[] = {"Thomas", "partitioned"};
+    const MassMatrixType mass_types[] = {MassMatrixType::Consistent, MassMatrixType::Lumped};
+    const char* mass_names[] = {"consistent", "lumped"};
+
+    bool ok = true;
+    for (int i = 0; i < 5; ++i) {
+        for (int b = 0; b < 2; ++b) {
+            for (int m = 0; m < 2; ++m) {
+                DiffusionSolver<LinearDiffusion> s(41, 2.0, 1e-3, 20);
+                s.set_num_threads(2);
+                s.set_theta(0.7);
+                s.set_boundary_values(2.0, 0.5);
+                s.set_time_integrator(integrators[i]);
+                s.set_linear_solver(backends[b]);
+                s.set_mass_matrix_type(mass_types[m]);
+                ok = check(string(integrator_names[i]) + ", " + backend_names[b] + ", " + mass_names[m], s) && ok;
+            }
+        }
+    }
+
+    // Features with their own code paths in the loop
+    const function<void(FEMSolver&)> features[] = {
+        [](FEMSolver& s) { s.set_adaptive_time_stepping(0.02); },
+        [](FEMSolver& s) { s.set_moving_mesh(5); },
+        [](FEMSolver& s) { s.set_source(SourceTerm{logistic, nullptr}); },
+        [](FEMSolver& s) { s.set_mesh(graded_mesh(41, 2.0, 1.5)); },
+    };
+    const char* feature_names[] = {"adaptive time stepping", "moving mesh", "source term", "graded mesh"};
+    for (int f = 0; f < 4; ++f) {
+        for (int i : {0, 2, 4}) {
+            DiffusionSolver<LinearDiffusion> s(41, 2.0, 1e-3, 20);
+            features[f](s);
+            s.set_boundary_values(2.0, 0.5);
+            s.set_time_integrator(integrators[i]);
+            ok = check(string(feature_names[f]) + ", " + integrator_names[i], s) && ok;
+        }
+    }
+
+    {
+        DiffusionSolver<PowerLawDiffusion> s(41, 2.0, 1e-3, 20);
+        s.set_boundary_values(2.0, 0.5);
+        s.set_stiffness_mode(StiffnessMode::Kirchhoff);
+        s.set_time_integrator(TimeIntegrator::CrankNicolson);
+        ok = check("Kirchhoff mode, Crank-Nicolson", s) && ok;
+    }
+    {
+        DiffusionSolver<ExpressionDiffusion> s(41, 2.0, 1e-3, 20, ExpressionDiffusion("1 + 0.5*u + 0.1*u^2"));
+        s.set_boundary_values(2.0, 0.5);
+        s.set_time_integrator(TimeIntegrator::BackwardEuler);
+        ok = check("expression law, backward Euler", s) && ok;
+    }
+    {
+        // Large enough for the kernels to split across threads
+        DiffusionSolver<LinearDiffusion> s(20000, 2.0, 1e-4, 3);
+        s.set_num_threads(2);
+        s.set_boundary_values(2.0, 0.5);
+        s.set_linear_solver(LinearSolverBackend::Partitioned);
+        s.set_time_integrator(TimeIntegrator::BackwardEuler);
+        ok = check("threaded kernels, partitioned, backward Euler", s) && ok;
+    }
+
+    for (int i : {0, 1, 2}) {
+        for (int m = 0; m < 2; ++m) {
+            EnsembleDiffusionSolver s(4, 41, 2.0, 1e-3, 20);
+            for (int k = 0; k < 4; ++k) s.set_member(k, 1.0 + 0.1 * k, 0.5, 2.0, 0.5, VectorXd::Ones(41));
+            s.set_time_integrator(integrators[i]);
+            s.set_mass_matrix_type(mass_types[m]);
+            ok = check(string("ensemble, ") + integrator_names[i] + ", " + mass_names[m], s) && ok;
+        }
+    }
+
+    cout << (ok ? "no allocations in the time loop" : "ALLOCATIONS IN THE TIME LOOP") << endl;
+    return ok ? 0 : 1;
+}
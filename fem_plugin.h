@@ -0,0 +1,47 @@
+/************************************************************************
+* fem_plugin.h: C ABI for shared-object plugins providing a diffusion law
+* D(u) and/or a source term f(x, u) to the 1D nonlinear diffusion solver.
+*
+* A plugin exports one function, fem_plugin(), returning a pointer to a
+* FemPlugin table with static storage duration. Entries a plugin does not
+* provide are null. For each of the diffusion law and the source term, the
+* scalar pair (value and derivative), the batch entry point, or both may be
+* given; the solver prefers the batch entry point, which is called with
+* whole arrays so the call overhead stays out of the assembly loops.
+* Batch derivative outputs (dD, df_du) may be null when not needed.
+* All entry points must be thread-safe: the solver calls them concurrently
+* on disjoint arrays.
+************************************************************************/
+#ifndef FEM_PLUGIN_H
+#define FEM_PLUGIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FEM_PLUGIN_ABI_VERSION 1
+#define FEM_PLUGIN_ENTRY "fem_plugin"
+
+typedef struct FemPlugin {
+    unsigned abi_version;  /* FEM_PLUGIN_ABI_VERSION the plugin was built against */
+    const char* name;      /* Human-readable name, for diagnostics */
+
+    /* Diffusion law D(u) */
+    double (*diffusion)(double u);
+    double (*diffusion_derivative)(double u);  /* dD/du */
+    void (*diffusion_batch)(const double* u, double* D, double* dD, int n);
+
+    /* Source term f(x, u) in du/dt = d/dx (D(u) du/dx) + f(x, u) */
+    double (*source)(double x, double u);
+    double (*source_derivative)(double x, double u);  /* df/du */
+    void (*source_batch)(const double* x, const double* u, double* f, double* df_du, int n);
+} FemPlugin;
+
+/* Entry point exported by every plugin */
+typedef const FemPlugin* (*FemPluginEntry)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FEM_PLUGIN_H */
@@ -1,7 +1,8 @@
 /************************************************************************
 * Governing equation: 1D Nonlinear Diffusion 
 * Spatial Numerical Discretization: Finite Element Method
-* Temporal integrating Technique: Finite Difference Forward Euler Method
+* Temporal integrating Technique: Forward/Backward Euler, theta-scheme,
+*   Crank-Nicolson, RKC and step-doubling adaptive time stepping
 * Structure paradigm: Object Oriented Programming
 * Author: Kiarash Jalali
 * Licensed under the Creative Commons Attribution-NoDerivatives 4.0, 
@@ -10,17 +11,639 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <cassert>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdlib>
+#include <string>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <dlfcn.h>
 #include <Eigen/Dense>
+#include "fem_plugin.h"
 
 using namespace std;
 using namespace Eigen;
 
+// TridiagonalMatrix: Banded storage for operators whose nonzeros sit on three diagonals
+class TridiagonalMatrix {
+public:
+    VectorXd lower;  // Sub-diagonal, lower(i) = A(i, i - 1), lower(0) unused
+    VectorXd diag;   // Main diagonal, diag(i) = A(i, i)
+    VectorXd upper;  // Super-diagonal, upper(i) = A(i, i + 1), upper(n - 1) unused
+
+    TridiagonalMatrix() = default;
+    explicit TridiagonalMatrix(int n)
+        : lower(VectorXd::Zero(n)), diag(VectorXd::Zero(n)), upper(VectorXd::Zero(n)) {}
+
+    int rows() const { return static_cast<int>(diag.size()); }
+
+    // Matrix-vector product y = A * x without forming the dense matrix
+    void multiply(const VectorXd& x, VectorXd& y) const {
+        const int n = rows();
+        if (n == 1) {
+            y(0) = diag(0) * x(0);
+            return;
+        }
+        y(0) = diag(0) * x(0) + upper(0) * x(1);
+        for (int i = 1; i < n - 1; ++i) {
+            y(i) = lower(i) * x(i - 1) + diag(i) * x(i) + upper(i) * x(i + 1);
+        }
+        y(n - 1) = lower(n - 1) * x(n - 2) + diag(n - 1) * x(n - 1);
+    }
+
+    VectorXd operator*(const VectorXd& x) const {
+        VectorXd y(rows());
+        multiply(x, y);
+        return y;
+    }
+
+    // Expand to a dense matrix (for verification against dense solvers only)
+    MatrixXd to_dense() const {
+        const int n = rows();
+        MatrixXd A = MatrixXd::Zero(n, n);
+        for (int i = 0; i < n; ++i) {
+            A(i, i) = diag(i);
+            if (i > 0) A(i, i - 1) = lower(i);
+            if (i < n - 1) A(i, i + 1) = upper(i);
+        }
+        return A;
+    }
+};
+
+// TridiagonalLU: Thomas-algorithm LU factorization A = L * U of a tridiagonal matrix
+// (no pivoting, valid for the SPD and diagonally dominant operators assembled here)
+class TridiagonalLU {
+    VectorXd multiplier;  // Sub-diagonal of the unit lower factor L
+    VectorXd inv_pivot;   // Reciprocal of the diagonal of U
+    VectorXd upper;       // Super-diagonal of U (equal to that of A)
+
+public:
+    TridiagonalLU() = default;
+    explicit TridiagonalLU(const TridiagonalMatrix& A) { compute(A); }
+
+    // Preallocate storage for n unknowns so that compute() does not allocate
+    void resize(int n) {
+        multiplier.resize(n);
+        inv_pivot.resize(n);
+        upper.resize(n);
+    }
+
+    // Factorize A in O(n)
+    void compute(const TridiagonalMatrix& A) {
+        const int n = A.rows();
+        multiplier.resize(n);
+        inv_pivot.resize(n);
+        upper = A.upper;
+        multiplier(0) = 0.0;
+        double pivot = A.diag(0);
+        for (int i = 0; i < n; ++i) {
+            if (i > 0) {
+                multiplier(i) = A.lower(i) * inv_pivot(i - 1);
+                pivot = A.diag(i) - multiplier(i) * upper(i - 1);
+            }
+            if (pivot == 0.0) {
+                throw runtime_error("TridiagonalLU: zero pivot, matrix is singular");
+            }
+            inv_pivot(i) = 1.0 / pivot;
+        }
+    }
+
+    // Solve A * x = b in O(n); x may alias b
+    void solve(const VectorXd& b, VectorXd& x) const {
+        const int n = static_cast<int>(inv_pivot.size());
+        x(0) = b(0);
+        for (int i = 1; i < n; ++i) {
+            x(i) = b(i) - multiplier(i) * x(i - 1);  // Forward sweep with L
+        }
+        x(n - 1) *= inv_pivot(n - 1);
+        for (int i = n - 2; i >= 0; --i) {
+            x(i) = (x(i) - upper(i) * x(i + 1)) * inv_pivot(i);  // Back substitution with U
+        }
+    }
+
+    VectorXd solve(const VectorXd& b) const {
+        VectorXd x(b.size());
+        solve(b, x);
+        return x;
+    }
+
+    // Solve A x_m = b_m in place for every row m of X (an N x n matrix holding one
+    // right-hand side per row). Column-major storage interleaves the systems, so each
+    // step of the recurrence is a contiguous vector operation across all of them.
+    void solve_batch(MatrixXd& X) const {
+        const int n = static_cast<int>(inv_pivot.size());
+        for (int i = 1; i < n; ++i) {
+            X.col(i) -= multiplier(i) * X.col(i - 1);
+        }
+        X.col(n - 1) *= inv_pivot(n - 1);
+        for (int i = n - 2; i >= 0; --i) {
+            X.col(i) = (X.col(i) - upper(i) * X.col(i + 1)) * inv_pivot(i);
+        }
+    }
+};
+
+// BatchedTridiagonalLU: Thomas factorizations of B independent tridiagonal systems of equal
+// size. Coefficients and right-hand sides are B x n column-major matrices (system index
+// fastest), so the recurrence runs along the columns while every column update is one
+// contiguous vector operation across all systems.
+class BatchedTridiagonalLU {
+    MatrixXd multiplier;  // Sub-diagonals of the unit lower factors
+    MatrixXd inv_pivot;   // Reciprocal diagonals of the upper factors
+    MatrixXd upper;       // Super-diagonals of the upper factors
+
+public:
+    // Preallocate storage for B systems of n unknowns so that compute() does not allocate
+    void resize(int batch, int n) {
+        multiplier.resize(batch, n);
+        inv_pivot.resize(batch, n);
+        upper.resize(batch, n);
+    }
+
+    // Factorize all systems; lower(b, i) = A_b(i, i - 1), diag(b, i) = A_b(i, i), upper(b, i) = A_b(i, i + 1).
+    // Storage is resized when the shape differs from the last resize() or compute().
+    void compute(const MatrixXd& lower_, const MatrixXd& diag_, const MatrixXd& upper_) {
+        assert(diag_.rows() == lower_.rows() && diag_.cols() == lower_.cols());
+        assert(upper_.rows() == lower_.rows() && upper_.cols() == lower_.cols());
+        if (multiplier.rows() != lower_.rows() || multiplier.cols() != lower_.cols()) {
+            resize(static_cast<int>(lower_.rows()), static_cast<int>(lower_.cols()));
+        }
+        const int n = static_cast<int>(diag_.cols());
+        upper = upper_;
+        multiplier.col(0).setZero();
+        inv_pivot.col(0) = diag_.col(0);  // Holds the pivots until inverted below
+        for (int i = 1; i < n; ++i) {
+            multiplier.col(i) = lower_.col(i).cwiseQuotient(inv_pivot.col(i - 1));
+            inv_pivot.col(i) = diag_.col(i) - multiplier.col(i).cwiseProduct(upper.col(i - 1));
+        }
+        if ((inv_pivot.array() == 0.0).any()) {
+            throw runtime_error("BatchedTridiagonalLU: zero pivot, matrix is singular");
+        }
+        inv_pivot = inv_pivot.cwiseInverse();
+    }
+
+    // Solve A_b x_b = b_b in place for every row b of X
+    void solve(MatrixXd& X) const {
+        assert(X.rows() == inv_pivot.rows() && X.cols() == inv_pivot.cols());
+        const int n = static_cast<int>(inv_pivot.cols());
+        for (int i = 1; i < n; ++i) {
+            X.col(i) -= multiplier.col(i).cwiseProduct(X.col(i - 1));
+        }
+        X.col(n - 1) = X.col(n - 1).cwiseProduct(inv_pivot.col(n - 1));
+        for (int i = n - 2; i >= 0; --i) {
+            X.col(i) = (X.col(i) - upper.col(i).cwiseProduct(X.col(i + 1))).cwiseProduct(inv_pivot.col(i));
+        }
+    }
+};
+
+// ThreadPool: Persistent worker threads running the tasks of parallel_for(). Each task
+// index writes its own output range, so results do not depend on which thread runs it.
+// Dispatch passes a function pointer and context, so a parallel_for allocates nothing.
+class ThreadPool {
+    vector<thread> workers;
+    mutex m;
+    condition_variable cv_start, cv_done;
+    void (*task)(void*, int) = nullptr;  // Type-erased body of the current parallel_for
+    void* ctx = nullptr;                 // Its closure
+    int n_tasks = 0;
+    atomic<int> next_task{0};
+    int busy = 0;                        // Workers still running the current batch
+    unsigned generation = 0;             // Incremented for every batch
+    bool stop = false;
+
+    void run_tasks() {
+        for (int i = next_task.fetch_add(1); i < n_tasks; i = next_task.fetch_add(1)) task(ctx, i);
+    }
+
+    // seen starts at the generation current when the worker is spawned, so a restarted
+    // worker does not mistake the last batch before resize() for a new one
+    void worker_loop(unsigned seen) {
+        for (;;) {
+            unique_lock<mutex> lock(m);
+            cv_start.wait(lock, [&] { return stop || generation != seen; });
+            if (stop) return;
+            seen = generation;
+            lock.unlock();
+            run_tasks();
+            lock.lock();
+            if (--busy == 0) cv_done.notify_one();
+        }
+    }
+
+    void shutdown() {
+        {
+            lock_guard<mutex> lock(m);
+            stop = true;
+        }
+        cv_start.notify_all();
+        for (thread& w : workers) w.join();
+        workers.clear();
+        stop = false;
+    }
+
+public:
+    explicit ThreadPool(int n_threads = 1) { resize(n_threads); }
+    ~ThreadPool() { shutdown(); }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads including the calling thread
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Restart with n_threads threads (the caller counts as one)
+    void resize(int n_threads) {
+        shutdown();
+        unsigned current;
+        {
+            lock_guard<mutex> lock(m);
+            current = generation;
+        }
+        for (int i = 1; i < n_threads; ++i) workers.emplace_back([this, current] { worker_loop(current); });
+    }
+
+    // Run f(i) for i = 0..n-1 across the pool and the calling thread; returns when all finished
+    template <class F>
+    void parallel_for(int n, F&& f) {
+        if (workers.empty() || n <= 1) {
+            for (int i = 0; i < n; ++i) f(i);
+            return;
+        }
+        using Fn = remove_reference_t<F>;
+        {
+            lock_guard<mutex> lock(m);
+            task = [](void* c, int i) { (*static_cast<Fn*>(c))(i); };
+            ctx = const_cast<void*>(static_cast<const void*>(&f));
+            n_tasks = n;
+            next_task = 0;
+            busy = static_cast<int>(workers.size());
+            ++generation;
+        }
+        cv_start.notify_all();
+        run_tasks();
+        unique_lock<mutex> lock(m);
+        cv_done.wait(lock, [&] { return busy == 0; });
+    }
+};
+
+// PartitionedTridiagonalLU: Parallel partition (SPIKE) solver for one tridiagonal system.
+// The rows are split into P contiguous blocks, one per thread. Each block is factorized
+// on its own, together with its two spikes v = A_p^-1 (a_s e_first) and w = A_p^-1 (c_e e_last)
+// that carry the coupling to the neighbouring blocks. A solve is three phases:
+// independent block solves y_p = A_p^-1 b_p (parallel), a 2P reduced system for the first
+// and last unknown of every block (sequential, pre-inverted at factorization time), and
+// the correction x_p = y_p - v x_{s-1} - w x_e (parallel).
+class PartitionedTridiagonalLU {
+    ThreadPool* pool = nullptr;  // Threads running the block phases (sequential if null)
+    int n_parts = 1;             // Number of blocks P
+    VectorXi start;              // Block p covers rows [start(p), start(p + 1))
+    VectorXd multiplier;         // Blockwise L factors
+    VectorXd inv_pivot;          // Blockwise reciprocal U diagonals
+    VectorXd upper;              // Super-diagonal of A
+    VectorXd spike_v, spike_w;   // Coupling to the previous / next block
+    MatrixXd reduced;            // 2P x 2P interface system (overwritten by its inversion)
+    MatrixXd reduced_inv;        // Inverse of the interface system
+    VectorXd y;                  // Block solutions of the current right-hand side
+    VectorXd reduced_rhs, reduced_x;
+
+    // Factorize rows [s, e) as an independent tridiagonal block; false on a zero pivot
+    bool factor_block(const TridiagonalMatrix& A, int s, int e) {
+        multiplier(s) = 0.0;
+        for (int i = s; i < e; ++i) {
+            double pivot = A.diag(i);
+            if (i > s) {
+                multiplier(i) = A.lower(i) * inv_pivot(i - 1);
+                pivot -= multiplier(i) * upper(i - 1);
+            }
+            if (pivot == 0.0) return false;
+            inv_pivot(i) = 1.0 / pivot;
+        }
+        return true;
+    }
+
+    // Solve the block [s, e) in place on x
+    void solve_block(int s, int e, VectorXd& x) const {
+        for (int i = s + 1; i < e; ++i) x(i) -= multiplier(i) * x(i - 1);
+        x(e - 1) *= inv_pivot(e - 1);
+        for (int i = e - 2; i >= s; --i) x(i) = (x(i) - upper(i) * x(i + 1)) * inv_pivot(i);
+    }
+
+    template <class F>
+    void for_each_block(F&& f) {
+        if (pool) {
+            pool->parallel_for(n_parts, f);
+        } else {
+            for (int p = 0; p < n_parts; ++p) f(p);
+        }
+    }
+
+public:
+    // Use the threads of pool for the block phases, with one block per thread
+    void set_thread_pool(ThreadPool* pool_) { pool = pool_; }
+
+    void compute(const TridiagonalMatrix& A) {
+        const int n = A.rows();
+        n_parts = max(1, min(pool ? pool->size() : 1, n / 2));  // Blocks of at least two rows
+        start.resize(n_parts + 1);
+        for (int p = 0; p <= n_parts; ++p) start(p) = static_cast<int>(static_cast<long long>(n) * p / n_parts);
+        multiplier.resize(n);
+        inv_pivot.resize(n);
+        upper = A.upper;
+        spike_v.setZero(n);
+        spike_w.setZero(n);
+        y.resize(n);
+        reduced_rhs.resize(2 * n_parts);
+        reduced_x.resize(2 * n_parts);
+
+        atomic<bool> singular{false};
+        for_each_block([&](int p) {
+            const int s = start(p), e = start(p + 1);
+            if (!factor_block(A, s, e)) {
+                singular = true;
+                return;
+            }
+            if (p > 0) {
+                spike_v(s) = A.lower(s);
+                solve_block(s, e, spike_v);
+            }
+            if (p < n_parts - 1) {
+                spike_w(e - 1) = A.upper(e - 1);
+                solve_block(s, e, spike_w);
+            }
+        });
+        if (singular) throw runtime_error("PartitionedTridiagonalLU: zero pivot, matrix is singular");
+
+        // Interface system in the unknowns (x_first(0), x_last(0), x_first(1), x_last(1), ...)
+        reduced.setIdentity(2 * n_parts, 2 * n_parts);
+        for (int p = 0; p < n_parts; ++p) {
+            const int s = start(p), e = start(p + 1);
+            for (int k = 0; k < 2; ++k) {
+                const int row = 2 * p + k, i = k == 0 ? s : e - 1;
+                if (p > 0) reduced(row, 2 * p - 1) += spike_v(i);              // x_last(p - 1)
+                if (p < n_parts - 1) reduced(row, 2 * p + 2) += spike_w(i);    // x_first(p + 1)
+            }
+        }
+        // Gauss-Jordan inversion with partial pivoting in member storage, so refactorizing a
+        // same-size system (e.g. after the mesh moved) allocates nothing
+        const int m = 2 * n_parts;
+        reduced_inv.setIdentity(m, m);
+        for (int c = 0; c < m; ++c) {
+            Index pivot_row;
+            reduced.col(c).tail(m - c).cwiseAbs().maxCoeff(&pivot_row);
+            pivot_row += c;
+            if (reduced(pivot_row, c) == 0.0) {
+                throw runtime_error("PartitionedTridiagonalLU: singular interface system");
+            }
+            reduced.row(c).swap(reduced.row(pivot_row));
+            reduced_inv.row(c).swap(reduced_inv.row(pivot_row));
+            const double inv = 1.0 / reduced(c, c);
+            reduced.row(c) *= inv;
+            reduced_inv.row(c) *= inv;
+            for (int r = 0; r < m; ++r) {
+                const double f = reduced(r, c);
+                if (r == c || f == 0.0) continue;
+                reduced.row(r) -= f * reduced.row(c);
+                reduced_inv.row(r) -= f * reduced_inv.row(c);
+            }
+        }
+    }
+
+    // Solve A * x = b; x may alias b
+    void solve(const VectorXd& b, VectorXd& x) {
+        for_each_block([&](int p) {
+            const int s = start(p), e = start(p + 1);
+            y.segment(s, e - s) = b.segment(s, e - s);
+            solve_block(s, e, y);
+        });
+        for (int p = 0; p < n_parts; ++p) {
+            reduced_rhs(2 * p) = y(start(p));
+            reduced_rhs(2 * p + 1) = y(start(p + 1) - 1);
+        }
+        reduced_x.noalias() = reduced_inv * reduced_rhs;
+        for_each_block([&](int p) {
+            const int s = start(p), e = start(p + 1);
+            const double x_prev = p > 0 ? reduced_x(2 * p - 1) : 0.0;
+            const double x_next = p < n_parts - 1 ? reduced_x(2 * p + 2) : 0.0;
+            for (int i = s; i < e; ++i) x(i) = y(i) - spike_v(i) * x_prev - spike_w(i) * x_next;
+        });
+    }
+};
+
+// Discretizations of the nonlinear diffusion operator in DiffusionSolver
+enum class StiffnessMode {
+    Galerkin,  // K(u) u with D(u) integrated over each element (default)
+    Kirchhoff  // A Phi(u): constant Laplacian A applied to the nodal Kirchhoff potential
+};
+
+// Linear solver backends available to FEMSolver
+enum class LinearSolverBackend {
+    Thomas,       // O(n) tridiagonal LU (default)
+    Partitioned,  // Multithreaded partition (SPIKE) solver, see FEMSolver::set_num_threads()
+    DenseQR       // Dense column-pivoting Householder QR, O(n^3), for verification only (mass
+                  // matrix only: Newton Jacobians then use the Thomas solver)
+};
+
+// ReferenceElement: Linear two-node element on [0, 1] with two-point Gauss quadrature.
+// Shape-function tables and element matrices are compile-time constants.
+struct ReferenceElement {
+    static constexpr int n_nodes = 2;  // Nodes per element
+    static constexpr int n_qp = 2;     // Quadrature points per element
+    static constexpr double qp_offset = 0.21132486540518711775;  // (1 - 1/sqrt(3)) / 2
+    static constexpr double weight[n_qp] = {0.5, 0.5};           // Gauss weights on [0, 1]
+    // Shape function values N_a(xi_q), indexed [q][a]
+    static constexpr double shape[n_qp][n_nodes] = {{1.0 - qp_offset, qp_offset},
+                                                    {qp_offset, 1.0 - qp_offset}};
+    static constexpr double grad[n_nodes] = {-1.0, 1.0};  // dN_a/dxi (constant)
+
+    // Element mass matrix int N_a N_b dxi (multiply by h)
+    static constexpr double mass(int a, int b) {
+        double m = 0.0;
+        for (int q = 0; q < n_qp; ++q) m += weight[q] * shape[q][a] * shape[q][b];
+        return m;
+    }
+
+    // Element stiffness matrix int dN_a/dxi dN_b/dxi dxi (multiply by D / h)
+    static constexpr double stiffness(int a, int b) { return grad[a] * grad[b]; }
+
+    // The stiffness entries as named constants for the element kernels, s_ab = stiffness(a, b)
+    static constexpr double s00 = grad[0] * grad[0], s01 = grad[0] * grad[1];
+    static constexpr double s10 = grad[1] * grad[0], s11 = grad[1] * grad[1];
+};
+
+static_assert(ReferenceElement::s01 == ReferenceElement::stiffness(0, 1) && ReferenceElement::s11 == ReferenceElement::stiffness(1, 1),
+              "named stiffness entries must match the element stiffness matrix");
+
+static_assert(ReferenceElement::mass(0, 0) > 1.0 / 3.0 - 1e-15 && ReferenceElement::mass(0, 0) < 1.0 / 3.0 + 1e-15,
+              "two-point Gauss must integrate the element mass matrix exactly");
+
+// Mass matrix discretizations available to FEMSolver
+enum class MassMatrixType {
+    Consistent,  // Galerkin mass matrix, tridiagonal (default)
+    Lumped       // Row-sum lumped, diagonal: the explicit update needs no linear solve
+};
+
+// Time integrators available to FEMSolver::solve()
+enum class TimeIntegrator {
+    ForwardEuler,   // Explicit, conditionally stable (default)
+    BackwardEuler,  // Implicit, unconditionally stable; Newton iterations on the nonlinear system
+    CrankNicolson,  // Theta scheme with theta = 1/2, second order in time
+    Theta,          // General theta scheme, theta set with FEMSolver::set_theta()
+    RKC             // Runge-Kutta-Chebyshev, explicit with a stability region growing like s^2
+};
+
+// NoMallocScope: Forbids Eigen heap allocations while alive (effective with -DEIGEN_RUNTIME_NO_MALLOC)
+struct NoMallocScope {
+    explicit NoMallocScope(bool active) {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        internal::set_is_malloc_allowed(!active);
+#else
+        (void)active;
+#endif
+    }
+    ~NoMallocScope() {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        internal::set_is_malloc_allowed(true);
+#endif
+    }
+};
+
+// AllowMallocScope: Re-permits Eigen heap allocations inside a NoMallocScope for rare,
+// deliberate events such as remeshing; the previous state is restored on exit
+struct AllowMallocScope {
+    AllowMallocScope() {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        previous = internal::is_malloc_allowed();
+        internal::set_is_malloc_allowed(true);
+#endif
+    }
+    ~AllowMallocScope() {
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+        internal::set_is_malloc_allowed(previous);
+#endif
+    }
+    bool previous = true;  // Allocation state on entry
+};
+
+// Stability safeguards for the forward Euler integrator with fixed steps
+enum class StabilityControl {
+    None,      // Use dt as given
+    Clamp,     // Reduce each step to the estimated stable size (the run covers less time)
+    Subcycle   // Split each step of size dt into equal stable sub-steps (default)
+};
+
+// AdaptiveControl: Settings and statistics of step-doubling adaptive time stepping
+struct AdaptiveControl {
+    bool enabled = false;     // Run to t_end with adaptive dt instead of nt fixed steps
+    double t_end = 0.0;       // Target end time
+    double rtol = 1e-4;       // Relative local error tolerance
+    double atol = 1e-6;       // Absolute local error tolerance
+    double safety = 0.9;      // Safety factor of the step-size controller
+    double min_factor = 0.2;  // Largest step-size reduction per step
+    double max_factor = 5.0;  // Largest step-size increase per step
+    int accepted = 0;         // Accepted steps of the last run
+    int rejected = 0;         // Rejected steps of the last run
+};
+
+// MeshAdaptation: Settings and statistics of h-adaptive refinement and coarsening
+struct MeshAdaptation {
+    bool enabled = false;           // Remesh during solve()
+    int interval = 10;              // Time steps (accepted steps when adaptive) between remesh events
+    double tol = 1e-3;              // Bisect elements whose indicator exceeds tol
+    double coarsen_fraction = 0.1;  // Merge neighbours whose indicators are both below coarsen_fraction * tol
+    double h_min = 0.0;             // Refinement never creates elements smaller than h_min
+    double h_max = 0.0;             // Coarsening never creates elements larger than h_max
+    int max_nodes = 1 << 20;        // Refinement stops at this node count
+    int remeshes = 0;               // Remesh events of the last run that changed the mesh
+    int refined = 0;                // Elements bisected in the last run
+    int coarsened = 0;              // Element pairs merged in the last run
+};
+
+// MovingMeshControl: Settings and statistics of the moving-mesh (r-adaptive) mode
+struct MovingMeshControl {
+    bool enabled = false;     // Move the nodes during solve()
+    int interval = 10;        // Time steps (accepted steps when adaptive) between node moves
+    double alpha = 3.0;       // Monitor strength: w = sqrt(1 + alpha (u' / mean |u'|)^2)
+    double relaxation = 1.0;  // Fraction of the way each node moves towards equidistribution
+    int smoothing = 2;        // Passes of a (1, 2, 1) / 4 filter over the monitor
+    int moves = 0;            // Node moves of the last run
+};
+
+// SourceTerm: Optional source f(x, u) in du/dt = d/dx (D(u) du/dx) + f(x, u), evaluated a
+// whole array of nodes per call. evaluate(context, x, u, f, df_du, n) fills f and, when
+// df_du is not null, df/du for the Newton Jacobian; it may run concurrently on disjoint ranges.
+struct SourceTerm {
+    void (*evaluate)(void* context, const double* x, const double* u, double* f, double* df_du, int n) = nullptr;
+    void* context = nullptr;  // Passed back to evaluate
+
+    explicit operator bool() const { return evaluate != nullptr; }
+};
+
+// SolverWorkspace: Vectors used inside the time-step loop, allocated once per mesh
+struct SolverWorkspace {
+    VectorXd d_elem;     // Element-averaged diffusion coefficients
+    MatrixX2d dd_elem;   // Derivatives of d_elem with respect to the two element nodes
+    VectorXd Ku;         // Stiffness action K(u) * u
+    VectorXd Ku_old;     // Stiffness action at the previous time level (theta schemes)
+    VectorXd rhs;        // Right-hand side of the mass system
+    VectorXd u_new;      // Solution at the next time level
+    VectorXd u_start;    // Start of an adaptive step, restored on rejection
+    VectorXd u_single;   // Adaptive step taken as one full step
+    VectorXd stage_prev; // RKC stage Y_{j-1}
+    VectorXd stage_prev2;// RKC stage Y_{j-2}
+    VectorXd f0;         // RKC right-hand side F(Y_0)
+    VectorXd residual;   // Newton residual
+    VectorXd delta;      // Newton update
+    VectorXd u_trial;    // Newton line-search iterate
+    VectorXd residual_trial;  // Its residual
+    VectorXd f_source;   // Nodal source values f(x_i, u_i)
+    VectorXd df_source;  // Nodal source derivatives df/du
+    VectorXd x_new;      // Moving mesh: target node coordinates
+    VectorXd monitor;    // Moving mesh: element monitor values
+    TridiagonalMatrix J; // Newton Jacobian
+    TridiagonalLU J_lu;  // Factorization of the Newton Jacobian
+    PartitionedTridiagonalLU J_plu;  // Its partitioned factorization (Partitioned backend)
+    TridiagonalMatrix P; // Mass matrix of the target mesh in the L2 transfer
+    TridiagonalLU P_lu;  // Factorization of P
+
+    void resize(int n) {
+        d_elem.resize(n - 1);
+        dd_elem.resize(n - 1, 2);
+        Ku.resize(n);
+        Ku_old.resize(n);
+        rhs.resize(n);
+        u_new.resize(n);
+        u_start.resize(n);
+        u_single.resize(n);
+        stage_prev.resize(n);
+        stage_prev2.resize(n);
+        f0.resize(n);
+        residual.resize(n);
+        delta.resize(n);
+        u_trial.resize(n);
+        residual_trial.resize(n);
+        f_source.resize(n);
+        df_source.resize(n);
+        x_new.resize(n);
+        monitor.resize(n - 1);
+        J = TridiagonalMatrix(n);
+        J_lu.resize(n);
+        P = TridiagonalMatrix(n);
+        P_lu.resize(n);
+    }
+};
+
 // AbstractFemSolver: Pure abstract base class for an FEM Solver
 class AbstractFemSolver {
 public:
     // Pure virtual methods for abstraction
-    virtual MatrixXd assemble_mass_matrix() = 0;
-    virtual MatrixXd assemble_stiffness_matrix() = 0;
+    virtual TridiagonalMatrix assemble_mass_matrix() = 0;
+    virtual TridiagonalMatrix assemble_stiffness_matrix() = 0;
+    virtual void apply_stiffness(const VectorXd& u, VectorXd& Ku) = 0;  // Matrix-free K(u) * u
     virtual void apply_boundary_conditions(VectorXd& u_new) = 0;
     virtual void solve() = 0;
     virtual void display_solution() = 0;
@@ -29,97 +652,2066 @@ public:
     virtual ~AbstractFemSolver() = default;
 };
 
+// Node coordinates for FEMSolver::set_mesh(). Uniform: nx equally spaced nodes on [0, L]
+inline VectorXd uniform_mesh(int nx, double L) {
+    if (nx < 2) throw invalid_argument("uniform_mesh: need at least two nodes");
+    return VectorXd::LinSpaced(nx, 0.0, L);
+}
+
+// Graded: x_i = L (i / (nx - 1))^p, clustering nodes at x = 0 for p > 1 (at x = L for p < 1)
+inline VectorXd graded_mesh(int nx, double L, double p) {
+    if (nx < 2 || !(p > 0.0)) throw invalid_argument("graded_mesh: need nx >= 2 and p > 0");
+    VectorXd x(nx);
+    for (int i = 0; i < nx; ++i) x[i] = L * pow(static_cast<double>(i) / (nx - 1), p);
+    return x;
+}
+
+// Geometric: element sizes growing by a constant ratio, h_{e+1} = r h_e (r < 1 clusters at x = L)
+inline VectorXd geometric_mesh(int nx, double L, double r) {
+    if (nx < 2 || !(r > 0.0)) throw invalid_argument("geometric_mesh: need nx >= 2 and r > 0");
+    const int n_el = nx - 1;
+    const double h0 = r == 1.0 ? L / n_el : L * (r - 1.0) / (pow(r, n_el) - 1.0);
+    VectorXd x(nx);
+    x[0] = 0.0;
+    double he = h0;
+    for (int e = 0; e < n_el; ++e, he *= r) x[e + 1] = x[e] + he;
+    x[nx - 1] = L;
+    return x;
+}
+
+// Mass matrix of linear elements of sizes h_elem (consistent, or row-sum lumped), with
+// identity rows at the two Dirichlet nodes. Shared by FEMSolver and EnsembleDiffusionSolver.
+inline void fe_mass_matrix(const VectorXd& h_elem, MassMatrixType type, TridiagonalMatrix& M) {
+    const int n = static_cast<int>(h_elem.size()) + 1;
+    M.lower.setZero(n);
+    M.diag.setZero(n);
+    M.upper.setZero(n);
+    for (int e = 0; e < n - 1; ++e) {
+        if (type == MassMatrixType::Lumped) {
+            M.diag(e) += h_elem[e] * (ReferenceElement::mass(0, 0) + ReferenceElement::mass(0, 1));
+            M.diag(e + 1) += h_elem[e] * (ReferenceElement::mass(1, 0) + ReferenceElement::mass(1, 1));
+        } else {
+            M.diag(e) += h_elem[e] * ReferenceElement::mass(0, 0);
+            M.upper(e) += h_elem[e] * ReferenceElement::mass(0, 1);
+            M.lower(e + 1) += h_elem[e] * ReferenceElement::mass(1, 0);
+            M.diag(e + 1) += h_elem[e] * ReferenceElement::mass(1, 1);
+        }
+    }
+    M.diag(0) = M.diag(n - 1) = 1.0;  // Dirichlet rows
+    M.upper(0) = M.lower(n - 1) = 0.0;
+}
+
+// Gershgorin bound on the spectral radius of M^-1 K: the largest absolute row sum of K,
+// k_row(i), over the smallest Gershgorin lower bound on the eigenvalues of M (row-wise when
+// M is lumped). Only the interior rows enter; the Dirichlet rows of K are zero.
+template <class RowSum>
+double gershgorin_spectral_radius(const TridiagonalMatrix& M, MassMatrixType type, RowSum k_row) {
+    const int n = M.rows();
+    double k_max = 0.0, m_min = numeric_limits<double>::infinity(), rho_lumped = 0.0;
+    for (int i = 1; i < n - 1; ++i) {
+        const double k = k_row(i);
+        k_max = max(k_max, k);
+        m_min = min(m_min, M.diag(i) - fabs(M.lower(i)) - fabs(M.upper(i)));
+        rho_lumped = max(rho_lumped, k / M.diag(i));
+    }
+    if (type == MassMatrixType::Lumped) return rho_lumped;
+    return n > 2 ? k_max / m_min : 0.0;
+}
+
+// Largest forward Euler step for spectral radius rho (h rho <= 2), scaled by safety
+inline double stable_step_size(double rho, double safety) {
+    return rho > 0.0 ? safety * 2.0 / rho : numeric_limits<double>::infinity();
+}
+
 // FEMSolver class inheriting from AbstractFemSolver, implementing general FEM functionality
 class FEMSolver: public AbstractFemSolver {
 protected:
     int nx;        // Number of nodes
     double L;      // Length of domain
-    double dx;     // Spatial step size
     double dt;     // Time step size
     int nt;        // Number of time steps
+    VectorXd x;    // Node coordinates
+    VectorXd h_elem;      // Element sizes h_e = x_{e+1} - x_e
+    VectorXd inv_h_elem;  // 1 / h_e
     VectorXd u;    // Solution vector
-    MatrixXd M;    // Mass matrix
+    TridiagonalMatrix M;  // Mass matrix
+    SourceTerm source;    // Optional source f(x, u)
+    MassMatrixType mass_type = MassMatrixType::Consistent;  // Consistent or lumped M
+    LinearSolverBackend backend = LinearSolverBackend::Thomas;  // Linear solve path
+    TimeIntegrator integrator = TimeIntegrator::ForwardEuler;  // Time stepping scheme
+    double theta = 0.5;         // Implicitness of TimeIntegrator::Theta (0 explicit, 1 backward Euler)
+    double newton_tol = 1e-10;  // Newton tolerance on the max-norm of the update
+    int newton_max_iter = 20;   // Newton iteration limit per implicit step
+    static constexpr int newton_max_backtracks = 10;  // Step-length halvings per Newton update
+    static constexpr int max_step_halvings = 6;       // Failed implicit steps are retried down to dt / 2^6
+    AdaptiveControl adapt;      // Adaptive time stepping settings and statistics
+    StabilityControl stability = StabilityControl::Subcycle;  // Explicit step-size safeguard
+    double stability_safety = 0.9;  // Fraction of the estimated stability limit actually used
+    TridiagonalLU M_lu;                  // Cached Thomas factorization of M
+    PartitionedTridiagonalLU M_plu;      // Cached partitioned factorization of M (Partitioned backend)
+    ThreadPool pool;                     // Threads used by the parallel kernels
+    static constexpr int parallel_grain = 4096;  // Minimum nodes per thread in parallel kernels
+    ColPivHouseholderQR<MatrixXd> M_qr;  // Cached dense factorization of M (DenseQR backend only)
+    bool mass_factorized = false;        // Whether the cache matches the current M and backend
+    SolverWorkspace work;                // Preallocated time-step workspaces
+    unsigned mesh_revision = 0;          // Incremented whenever the mesh changes
+    MeshAdaptation amr;                  // h-adaptivity settings and statistics
+    MovingMeshControl moving;            // r-adaptivity settings and statistics
+
+    // Scatter element matrices into a tridiagonal operator: A += sum_e factor * coeff_e * ref(a, b)
+    template <class RefMatrix>
+    void assemble_elements(const VectorXd& coeff, double factor, RefMatrix ref, TridiagonalMatrix& A) const {
+        const double r00 = ref(0, 0), r01 = ref(0, 1), r10 = ref(1, 0), r11 = ref(1, 1);
+        for (int e = 0; e < nx - 1; ++e) {
+            const double scale = factor * coeff[e];
+            A.diag(e) += scale * r00;
+            A.upper(e) += scale * r01;
+            A.lower(e + 1) += scale * r10;
+            A.diag(e + 1) += scale * r11;
+        }
+    }
+
+    // Replace the boundary rows with Dirichlet rows: identity (mass) or zero (stiffness)
+    void apply_dirichlet_rows(TridiagonalMatrix& A, double diag_value) const {
+        A.diag(0) = diag_value;
+        A.upper(0) = 0.0;
+        A.diag(nx - 1) = diag_value;
+        A.lower(nx - 1) = 0.0;
+    }
+
+    // Run f(begin, end) over [0, n) split into contiguous chunks, one per thread. Chunks
+    // below parallel_grain items are not worth a thread, so small meshes run inline.
+    template <class F>
+    void parallel_range(int n, F&& f) {
+        const int chunks = max(1, min(pool.size(), n / parallel_grain));
+        if (chunks == 1) {
+            f(0, n);
+            return;
+        }
+        pool.parallel_for(chunks, [&](int c) {
+            f(static_cast<int>(static_cast<long long>(n) * c / chunks),
+              static_cast<int>(static_cast<long long>(n) * (c + 1) / chunks));
+        });
+    }
+
+    // Stiffness matrix from element-averaged diffusion coefficients d_elem. Each row is
+    // gathered from its two adjacent elements, so rows are independent and the result
+    // does not depend on the number of threads.
+    void assemble_element_stiffness(const VectorXd& d_elem, TridiagonalMatrix& K) {
+        parallel_range(nx - 2, [&](int begin, int end) {
+            for (int i = begin + 1; i < end + 1; ++i) {
+                const double k_left = d_elem[i - 1] * inv_h_elem[i - 1], k_right = d_elem[i] * inv_h_elem[i];
+                K.lower(i) = k_left * ReferenceElement::s10;
+                K.diag(i) = k_left * ReferenceElement::s11 + k_right * ReferenceElement::s00;
+                K.upper(i) = k_right * ReferenceElement::s01;
+            }
+        });
+        K.lower(0) = 0.0;
+        K.upper(nx - 1) = 0.0;
+        apply_dirichlet_rows(K, 0.0);
+    }
+
+    // Matrix-free stiffness action Kv = K(d_elem) * v, gathered node by node so every
+    // output entry is written once from its two adjacent elements
+    void apply_element_stiffness(const VectorXd& d_elem, const VectorXd& v, VectorXd& Kv) {
+        Kv[0] = 0.0;  // Dirichlet row at x = 0
+        parallel_range(nx - 2, [&](int begin, int end) {
+            for (int i = begin + 1; i < end + 1; ++i) {
+                Kv[i] = d_elem[i - 1] * inv_h_elem[i - 1]
+                          * (ReferenceElement::s10 * v[i - 1] + ReferenceElement::s11 * v[i])
+                      + d_elem[i] * inv_h_elem[i]
+                          * (ReferenceElement::s00 * v[i] + ReferenceElement::s01 * v[i + 1]);
+            }
+        });
+        Kv[nx - 1] = 0.0;  // Dirichlet row at x = L
+    }
+
+    // Jacobian of v -> K(v) * v: the stiffness matrix plus the contribution of dD/du,
+    // J_e(a, b) = (d_e S_ab + (S_a . v_e) dd_e(b)) / h_e, gathered row by row like the stiffness
+    void assemble_element_jacobian(const VectorXd& d_elem, const MatrixX2d& dd_elem,
+                                   const VectorXd& v, TridiagonalMatrix& J) {
+        parallel_range(nx - 2, [&](int begin, int end) {
+            for (int i = begin + 1; i < end + 1; ++i) {
+                const double k_left = d_elem[i - 1] * inv_h_elem[i - 1], k_right = d_elem[i] * inv_h_elem[i];
+                const double flux_left =  // S_1 . v_{i-1} / h_{i-1}
+                    (ReferenceElement::s10 * v[i - 1] + ReferenceElement::s11 * v[i]) * inv_h_elem[i - 1];
+                const double flux_right =  // S_0 . v_i / h_i
+                    (ReferenceElement::s00 * v[i] + ReferenceElement::s01 * v[i + 1]) * inv_h_elem[i];
+                J.lower(i) = k_left * ReferenceElement::s10 + flux_left * dd_elem(i - 1, 0);
+                J.diag(i) = k_left * ReferenceElement::s11 + flux_left * dd_elem(i - 1, 1)
+                          + k_right * ReferenceElement::s00 + flux_right * dd_elem(i, 0);
+                J.upper(i) = k_right * ReferenceElement::s01 + flux_right * dd_elem(i, 1);
+            }
+        });
+        J.lower(0) = 0.0;
+        J.upper(nx - 1) = 0.0;
+        apply_dirichlet_rows(J, 0.0);
+    }
+
+    // Nodal source values (and derivatives when df is not null) at state v, evaluated in
+    // one call per thread chunk
+    void evaluate_source(const VectorXd& v, VectorXd& f, VectorXd* df) {
+        parallel_range(nx, [&](int begin, int end) {
+            source.evaluate(source.context, x.data() + begin, v.data() + begin, f.data() + begin,
+                            df ? df->data() + begin : nullptr, end - begin);
+        });
+    }
+
+    // Spatial operator N(v) = K(v) v - F(v) of M dv/dt = -N(v), with the source load
+    // F = M f(x, v) interpolated at the nodes; F vanishes on the Dirichlet rows
+    void apply_operator(const VectorXd& v, VectorXd& Nv) {
+        apply_stiffness(v, Nv);
+        if (!source) return;
+        evaluate_source(v, work.f_source, nullptr);
+        const VectorXd& f = work.f_source;
+        for (int i = 1; i < nx - 1; ++i) {
+            Nv[i] -= M.lower(i) * f[i - 1] + M.diag(i) * f[i] + M.upper(i) * f[i + 1];
+        }
+    }
+
+    // Jacobian of the spatial operator: d(K(v) v)/dv - M diag(df/du)
+    void apply_operator_jacobian(const VectorXd& v, TridiagonalMatrix& J) {
+        apply_stiffness_jacobian(v, J);
+        if (!source) return;
+        evaluate_source(v, work.f_source, &work.df_source);
+        const VectorXd& df = work.df_source;
+        for (int i = 1; i < nx - 1; ++i) {
+            J.lower(i) -= M.lower(i) * df[i - 1];
+            J.diag(i) -= M.diag(i) * df[i];
+            J.upper(i) -= M.upper(i) * df[i + 1];
+        }
+    }
+
+    // Geometry, mass matrix and workspaces for new node coordinates; u is left to the caller
+    void rebuild_mesh(const VectorXd& nodes) {
+        if (nodes.size() < 3) throw invalid_argument("FEMSolver: a mesh needs at least three nodes");
+        for (Index i = 1; i < nodes.size(); ++i) {
+            if (!(nodes[i] > nodes[i - 1])) {
+                throw invalid_argument("FEMSolver: node coordinates must be strictly increasing");
+            }
+        }
+        nx = static_cast<int>(nodes.size());
+        x = nodes;
+        L = x[nx - 1] - x[0];
+        h_elem = x.tail(nx - 1) - x.head(nx - 1);
+        inv_h_elem = h_elem.cwiseInverse();
+        M = assemble_mass_matrix();  // Assemble mass matrix
+        mass_factorized = false;
+        work.resize(nx);
+        ++mesh_revision;
+    }
+
+    // Conservative transfer between two meshes of the same interval: the L2 projection of
+    // the piecewise linear u_old onto the new mesh, M_new u_new = (N_new, u_old). The load is
+    // integrated over the union of both meshes, where both factors are linear, so the
+    // reference Gauss rule is exact. The new basis sums to one, hence int u_new = int u_old.
+    // M_new, load and lu are scratch space; sized for x_new, they are used without allocation.
+    static void project_l2(const VectorXd& x_old, const VectorXd& u_old, const VectorXd& x_new, VectorXd& u_new,
+                           TridiagonalMatrix& M_new, VectorXd& load, TridiagonalLU& lu) {
+        const int n_old = static_cast<int>(x_old.size()), n_new = static_cast<int>(x_new.size());
+        M_new.lower.setZero(n_new);
+        M_new.diag.setZero(n_new);
+        M_new.upper.setZero(n_new);
+        load.setZero(n_new);
+        int e_old = 0;
+        for (int e = 0; e < n_new - 1; ++e) {
+            const double h_new = x_new[e + 1] - x_new[e];
+            M_new.diag(e) += h_new * ReferenceElement::mass(0, 0);
+            M_new.upper(e) += h_new * ReferenceElement::mass(0, 1);
+            M_new.lower(e + 1) += h_new * ReferenceElement::mass(1, 0);
+            M_new.diag(e + 1) += h_new * ReferenceElement::mass(1, 1);
+
+            // Walk the pieces [a, b] of the new element cut by the old nodes
+            double a = x_new[e];
+            while (a < x_new[e + 1]) {
+                while (e_old < n_old - 2 && x_old[e_old + 1] <= a) ++e_old;
+                const double b = min(x_new[e + 1], x_old[e_old + 1]);
+                const double h_old = x_old[e_old + 1] - x_old[e_old];
+                for (int q = 0; q < ReferenceElement::n_qp; ++q) {
+                    const double x_q = a + ReferenceElement::shape[q][1] * (b - a);
+                    const double w = ReferenceElement::weight[q] * (b - a);
+                    const double s = (x_q - x_old[e_old]) / h_old;
+                    const double u_q = (1.0 - s) * u_old[e_old] + s * u_old[e_old + 1];
+                    const double n1 = (x_q - x_new[e]) / h_new;
+                    load[e] += w * (1.0 - n1) * u_q;
+                    load[e + 1] += w * n1 * u_q;
+                }
+                a = b;
+            }
+        }
+        lu.compute(M_new);
+        lu.solve(load, u_new);
+    }
+
+    // Element error indicator from the jumps of du/dx at the element's end nodes:
+    // eta_e = h_e max(|[u']|_e, |[u']|_{e+1}), which estimates h_e^2 |u''| on element e
+    void mesh_indicator(VectorXd& eta) const {
+        eta.resize(nx - 1);
+        double slope_prev = (u[1] - u[0]) * inv_h_elem[0];
+        double jump_left = 0.0;
+        for (int e = 0; e < nx - 1; ++e) {
+            const double slope_next = e + 1 < nx - 1 ? (u[e + 2] - u[e + 1]) * inv_h_elem[e + 1] : slope_prev;
+            const double jump_right = fabs(slope_next - slope_prev);
+            eta[e] = h_elem[e] * max(jump_left, jump_right);
+            slope_prev = slope_next;
+            jump_left = jump_right;
+        }
+    }
+
+    // Remesh event: bisect elements with eta_e > tol, merge neighbouring pairs whose
+    // indicators are both below coarsen_fraction * tol, project u onto the new mesh and
+    // rebuild and refactor everything mesh-dependent. Allocates, so it is only run every
+    // amr.interval steps; returns false, leaving the mesh untouched, if nothing was marked.
+    bool adapt_mesh() {
+        AllowMallocScope allow_malloc;
+        VectorXd eta;
+        mesh_indicator(eta);
+        const double coarsen_tol = amr.coarsen_fraction * amr.tol;
+        const int n_el = nx - 1;
+        vector<double> nodes;
+        nodes.reserve(2 * nx);
+        nodes.push_back(x[0]);
+        int refined = 0, coarsened = 0;
+        for (int e = 0; e < n_el;) {
+            const bool can_merge = e + 1 < n_el && nx - coarsened > 3 && h_elem[e] + h_elem[e + 1] <= amr.h_max;
+            if (can_merge && eta[e] < coarsen_tol && eta[e + 1] < coarsen_tol) {
+                nodes.push_back(x[e + 2]);  // Drop node e + 1
+                ++coarsened;
+                e += 2;
+                continue;
+            }
+            const int projected_nodes = static_cast<int>(nodes.size()) + (n_el - e) + 1;
+            if (eta[e] > amr.tol && 0.5 * h_elem[e] >= amr.h_min && projected_nodes <= amr.max_nodes) {
+                nodes.push_back(0.5 * (x[e] + x[e + 1]));
+                ++refined;
+            }
+            nodes.push_back(x[e + 1]);
+            ++e;
+        }
+        if (refined == 0 && coarsened == 0) return false;
+
+        const VectorXd x_new = Map<const VectorXd>(nodes.data(), static_cast<Index>(nodes.size()));
+        VectorXd u_new(x_new.size()), load;
+        TridiagonalMatrix P;
+        TridiagonalLU P_lu;
+        project_l2(x, u, x_new, u_new, P, load, P_lu);
+        rebuild_mesh(x_new);
+        u = u_new;
+        apply_boundary_conditions(u);
+        factorize_mass();
+        prepare_time_loop();
+        ++amr.remeshes;
+        amr.refined += refined;
+        amr.coarsened += coarsened;
+        return true;
+    }
+
+    // Moving-mesh event with the node count fixed: equidistribute the element monitor
+    // w_e = sqrt(1 + alpha (u'_e / mean |u'|)^2), smoothed to keep neighbouring elements
+    // comparable, move every node part of the way to its equidistributed position and remap u
+    // by L2 projection. M is reassembled and refactored in place; everything works in the
+    // preallocated workspace, so moves run inside the allocation-free time loop.
+    void move_mesh() {
+        const int n_el = nx - 1;
+        VectorXd& w = work.monitor;
+        double mean_slope = 0.0;
+        for (int e = 0; e < n_el; ++e) {
+            w[e] = (u[e + 1] - u[e]) * inv_h_elem[e];
+            mean_slope += fabs(u[e + 1] - u[e]);
+        }
+        mean_slope /= L;
+        if (!(mean_slope > 0.0)) return;  // Flat solution: nothing to track
+        const double scale = moving.alpha / (mean_slope * mean_slope);
+        for (int e = 0; e < n_el; ++e) w[e] = sqrt(1.0 + scale * w[e] * w[e]);
+        for (int pass = 0; pass < moving.smoothing; ++pass) {
+            double prev = w[0];
+            for (int e = 0; e < n_el; ++e) {
+                const double cur = w[e];
+                const double next = e + 1 < n_el ? w[e + 1] : cur;
+                w[e] = 0.25 * (prev + 2.0 * cur + next);
+                prev = cur;
+            }
+        }
+
+        // W(x) = int w dx is piecewise linear; node j moves towards W^-1(j W_total / n_el)
+        double total = 0.0;
+        for (int e = 0; e < n_el; ++e) total += w[e] * h_elem[e];
+        VectorXd& x_new = work.x_new;
+        x_new[0] = x[0];
+        x_new[n_el] = x[n_el];
+        int e = 0;
+        double W_left = 0.0;  // W(x[e])
+        for (int j = 1; j < n_el; ++j) {
+            const double target = total * j / n_el;
+            while (e < n_el - 1 && W_left + w[e] * h_elem[e] < target) {
+                W_left += w[e] * h_elem[e];
+                ++e;
+            }
+            const double x_eq = min(x[e] + (target - W_left) / w[e], x[e + 1]);
+            x_new[j] = (1.0 - moving.relaxation) * x[j] + moving.relaxation * x_eq;
+        }
+
+        project_l2(x, u, x_new, work.u_new, work.P, work.rhs, work.P_lu);
+        x.swap(x_new);
+        h_elem = x.tail(n_el) - x.head(n_el);
+        inv_h_elem = h_elem.cwiseInverse();
+        assemble_mass(M);
+        factorize_mass();
+        u.swap(work.u_new);
+        apply_boundary_conditions(u);
+        ++mesh_revision;
+        prepare_time_loop();
+        ++moving.moves;
+    }
+
+    // Mass matrix of the current mesh into A (sized nx): element loop over the reference mass
+    // matrix scaled by each element's size, or its row-sum lumped version
+    void assemble_mass(TridiagonalMatrix& A) const { fe_mass_matrix(h_elem, mass_type, A); }
+
+    // Factorize the constant mass matrix once; reused by every time step
+    void factorize_mass() {
+        if (backend == LinearSolverBackend::DenseQR) {
+            M_qr.compute(M.to_dense());
+        } else if (backend == LinearSolverBackend::Partitioned) {
+            M_plu.set_thread_pool(&pool);
+            M_plu.compute(M);
+            // The Newton Jacobian has the size and block layout of M: factorizing M here sizes
+            // the partitioned Jacobian storage outside the allocation-free time loop
+            work.J_plu.set_thread_pool(&pool);
+            work.J_plu.compute(M);
+        } else {
+            M_lu.compute(M);
+        }
+        mass_factorized = true;
+    }
+
+    // Solve M * y = b using the cached factorization (computed lazily on first use); y may alias b
+    void solve_mass_system(const VectorXd& b, VectorXd& y) {
+        if (!mass_factorized) factorize_mass();
+        if (backend == LinearSolverBackend::DenseQR) {
+            y = M_qr.solve(b);
+        } else if (backend == LinearSolverBackend::Partitioned) {
+            M_plu.solve(b, y);
+        } else {
+            M_lu.solve(b, y);
+        }
+    }
 
 public:
     // Constructor initializing FEMSolver with parameters and setting up the initial mass matrix
     FEMSolver(int nx_, double L_, double dt_, int nt_)
         : nx(nx_), L(L_), dt(dt_), nt(nt_) {
-        dx = L / (nx - 1);
+        set_mesh(nx_, L_);
+    }
+
+    // (Re)build a uniform mesh of nx_ nodes on [0, L_]
+    void set_mesh(int nx_, double L_) { set_mesh(uniform_mesh(nx_, L_)); }
+
+    // (Re)build the mesh from strictly increasing node coordinates: resets the solution,
+    // reassembles M and drops its factorization
+    void set_mesh(const VectorXd& nodes) {
+        rebuild_mesh(nodes);
         u = VectorXd::Ones(nx);  // Initialize solution vector to ones
-        M = assemble_mass_matrix();  // Assemble mass matrix
     }
 
+    const VectorXd& nodes() const { return x; }
+    const VectorXd& solution() const { return u; }
+
     // Encapsulated mass matrix assembly (same for all solvers)
-    MatrixXd assemble_mass_matrix() override {
-        MatrixXd M = MatrixXd::Zero(nx, nx);
-        for (int i = 1; i < nx - 1; ++i) {
-            M(i, i) = 2.0 / 3.0 * dx;
-            M(i, i - 1) = 1.0 / 6.0 * dx;
-            M(i - 1, i) = 1.0 / 6.0 * dx;
-        }
-        M(0, 0) = 1.0;  // Dirichlet boundary condition at x = 0
-        M(nx - 1, nx - 1) = 1.0;  // Dirichlet boundary condition at x = L
-        return M;
+    TridiagonalMatrix assemble_mass_matrix() override {
+        TridiagonalMatrix mass(nx);
+        assemble_mass(mass);
+        return mass;
     }
 
     // Virtual methods for derived classes
-    virtual MatrixXd assemble_stiffness_matrix() = 0;
+    virtual TridiagonalMatrix assemble_stiffness_matrix() = 0;
+    virtual void apply_stiffness(const VectorXd& u, VectorXd& Ku) = 0;
+    virtual void apply_stiffness_jacobian(const VectorXd& u, TridiagonalMatrix& J) = 0;  // d(K(u) u)/du
+    virtual void element_diffusion(const VectorXd& u, VectorXd& d_elem) = 0;  // Element-averaged D(u)
     virtual void apply_boundary_conditions(VectorXd& u_new) = 0;
 
-    // Function to run the simulation (solving the system over time)
+    // Add a source term f(x, u) to the equation (an empty SourceTerm removes it)
+    void set_source(const SourceTerm& source_) { source = source_; }
+
+    // Select the time integrator used by solve()
+    void set_time_integrator(TimeIntegrator integrator_) { integrator = integrator_; }
+
+    // Weight of the new time level for TimeIntegrator::Theta, in [0, 1]
+    void set_theta(double theta_) {
+        if (theta_ < 0.0 || theta_ > 1.0) throw invalid_argument("FEMSolver: theta must lie in [0, 1]");
+        theta = theta_;
+    }
+
+    // Run solve() to t_end with step-doubling error control instead of nt steps of size dt;
+    // dt becomes the initial step size
+    void set_adaptive_time_stepping(double t_end, double rtol = 1e-4, double atol = 1e-6) {
+        if (!(t_end > 0.0 && rtol > 0.0 && atol > 0.0)) {
+            throw invalid_argument("FEMSolver: adaptive time stepping needs t_end, rtol and atol > 0");
+        }
+        adapt.enabled = true;
+        adapt.t_end = t_end;
+        adapt.rtol = rtol;
+        adapt.atol = atol;
+    }
+
+    const AdaptiveControl& adaptive_statistics() const { return adapt; }
+
+    // Remesh every interval steps of solve(): bisect elements whose gradient-jump indicator
+    // exceeds tol (down to h_min) and merge flat neighbours (up to h_max; 0 keeps the
+    // largest element of the current mesh as the limit)
+    void set_mesh_adaptation(double tol, int interval = 10, double h_min = 0.0, double h_max = 0.0) {
+        if (!(tol > 0.0) || interval < 1) {
+            throw invalid_argument("FEMSolver: mesh adaptation needs tol > 0 and interval >= 1");
+        }
+        amr.enabled = true;
+        amr.tol = tol;
+        amr.interval = interval;
+        amr.h_min = h_min;
+        amr.h_max = h_max > 0.0 ? h_max : h_elem.maxCoeff();
+    }
+
+    // Coarsening threshold as a fraction of tol, in [0, 1), and the node count at which
+    // refinement stops; defaults 0.1 and 2^20
+    void set_mesh_adaptation_limits(double coarsen_fraction, int max_nodes) {
+        if (!(coarsen_fraction >= 0.0 && coarsen_fraction < 1.0) || max_nodes < 3) {
+            throw invalid_argument("FEMSolver: mesh adaptation needs 0 <= coarsen_fraction < 1 and max_nodes >= 3");
+        }
+        amr.coarsen_fraction = coarsen_fraction;
+        amr.max_nodes = max_nodes;
+    }
+
+    const MeshAdaptation& mesh_adaptation_statistics() const { return amr; }
+
+    // Move the nodes every interval steps of solve() towards equidistribution of the monitor
+    // w = sqrt(1 + alpha (u' / mean |u'|)^2); the node count and all storage stay fixed. Every
+    // move remaps u, which adds a little numerical diffusion, so moving every step is rarely best.
+    void set_moving_mesh(int interval = 10, double alpha = 3.0, double relaxation = 1.0, int smoothing = 2) {
+        if (interval < 1 || !(alpha >= 0.0) || !(relaxation > 0.0 && relaxation <= 1.0) || smoothing < 0) {
+            throw invalid_argument("FEMSolver: moving mesh needs interval >= 1, alpha >= 0, "
+                                   "relaxation in (0, 1] and smoothing >= 0");
+        }
+        moving.enabled = true;
+        moving.interval = interval;
+        moving.alpha = alpha;
+        moving.relaxation = relaxation;
+        moving.smoothing = smoothing;
+    }
+
+    const MovingMeshControl& moving_mesh_statistics() const { return moving; }
+
+    // Select how forward Euler guards against steps beyond its stability limit, and the
+    // fraction of the estimated limit it actually uses
+    void set_stability_control(StabilityControl stability_, double safety = 0.9) {
+        if (!(safety > 0.0 && safety <= 1.0)) throw invalid_argument("FEMSolver: stability safety must lie in (0, 1]");
+        stability = stability_;
+        stability_safety = safety;
+    }
+
+    // Gershgorin bound on the spectral radius of M^-1 K(u), see gershgorin_spectral_radius()
+    double estimate_spectral_radius(const VectorXd& u_in) {
+        element_diffusion_bound(u_in, work.d_elem);
+        return gershgorin_spectral_radius(M, mass_type, [&](int i) {
+            return 2.0 * (work.d_elem[i - 1] * inv_h_elem[i - 1] + work.d_elem[i] * inv_h_elem[i]);  // |K_ii| + |K_i,i-1| + |K_i,i+1|
+        });
+    }
+
+    // Largest forward Euler step considered stable at state u_in (dt rho <= 2, with safety margin)
+    double stable_time_step(const VectorXd& u_in) {
+        return stable_step_size(estimate_spectral_radius(u_in), stability_safety);
+    }
+
+    // Newton controls for the implicit integrators
+    void set_newton_parameters(double tol, int max_iter) {
+        newton_tol = tol;
+        newton_max_iter = max_iter;
+    }
+
+    // Number of threads used by the parallel kernels (the calling thread counts as one)
+    void set_num_threads(int n_threads) {
+        pool.resize(n_threads);
+        if (backend == LinearSolverBackend::Partitioned) mass_factorized = false;
+    }
+
+    // Switch between consistent and lumped mass; reassembles M and drops its factorization
+    void set_mass_matrix_type(MassMatrixType type) {
+        mass_type = type;
+        M = assemble_mass_matrix();
+        mass_factorized = false;
+    }
+
+    // Select the linear solver used for the mass-matrix system
+    void set_linear_solver(LinearSolverBackend backend_) {
+        if (backend_ != backend) mass_factorized = false;
+        backend = backend_;
+    }
+
+protected:
+    // Forward Euler step of size h: M u_new = M u - h (K(u) u - F(u))
+    void step_forward_euler(double h) {
+        apply_operator(u, work.Ku);  // K(u) * u - F(u) without assembling K
+        if (mass_type == MassMatrixType::Lumped) {
+            work.u_new = u - h * work.Ku.cwiseQuotient(M.diag);  // Pointwise update, no solve
+        } else {
+            M.multiply(u, work.rhs);
+            work.rhs -= h * work.Ku;
+            solve_mass_system(work.rhs, work.u_new);
+        }
+    }
+
+    // Semi-discrete right-hand side f = -M^-1 N(y), N(y) = K(y) y - F(y)
+    void evaluate_rhs(const VectorXd& y, VectorXd& f) {
+        apply_operator(y, work.Ku);
+        if (mass_type == MassMatrixType::Lumped) {
+            f = -work.Ku.cwiseQuotient(M.diag);
+        } else {
+            f = -work.Ku;
+            solve_mass_system(f, f);
+        }
+    }
+
+    // Second-order Runge-Kutta-Chebyshev step of size h (Verwer, Hundsdorfer & Sommeijer).
+    // The stage count s is chosen from the Gershgorin spectral radius so that h rho lies
+    // inside the stability interval of length ~0.65 s^2; damping eps = 2/13.
+    void step_rkc(double h) {
+        const double rho = estimate_spectral_radius(u);
+        const int s = 1 + static_cast<int>(sqrt(1.0 + 1.54 * h * rho));  // At least two stages
+        const double eps = 2.0 / 13.0;
+        const double w0 = 1.0 + eps / (s * s);
+
+        // Chebyshev polynomial T_s and its derivatives at w0 give w1 = T_s'(w0) / T_s''(w0)
+        double t_prev = 1.0, t_cur = w0, dt_prev = 0.0, dt_cur = 1.0, ddt_prev = 0.0, ddt_cur = 0.0;
+        for (int j = 2; j <= s; ++j) {
+            double t_next = 2.0 * w0 * t_cur - t_prev;
+            double dt_next = 2.0 * t_cur + 2.0 * w0 * dt_cur - dt_prev;
+            double ddt_next = 4.0 * dt_cur + 2.0 * w0 * ddt_cur - ddt_prev;
+            t_prev = t_cur; t_cur = t_next;
+            dt_prev = dt_cur; dt_cur = dt_next;
+            ddt_prev = ddt_cur; ddt_cur = ddt_next;
+        }
+        const double w1 = dt_cur / ddt_cur;
+
+        // Stage 1: Y_1 = Y_0 + mu~_1 h F(Y_0), with b_0 = b_1 = b_2 = 1 / (4 w0^2)
+        const double b2 = 1.0 / (4.0 * w0 * w0);
+        evaluate_rhs(u, work.f0);
+        work.stage_prev2 = u;
+        work.stage_prev = u + b2 * w1 * h * work.f0;
+
+        // Stages j = 2..s from the three-term recurrence; T_j and b_j are updated on the fly
+        double b_jm2 = b2, b_jm1 = b2;
+        double tj_m2 = 1.0, tj_m1 = w0, dtj_m2 = 0.0, dtj_m1 = 1.0, ddtj_m2 = 0.0, ddtj_m1 = 0.0;
+        for (int j = 2; j <= s; ++j) {
+            const double tj = 2.0 * w0 * tj_m1 - tj_m2;
+            const double dtj = 2.0 * tj_m1 + 2.0 * w0 * dtj_m1 - dtj_m2;
+            const double ddtj = 4.0 * dtj_m1 + 2.0 * w0 * ddtj_m1 - ddtj_m2;
+            const double b_j = ddtj / (dtj * dtj);
+            const double mu = 2.0 * b_j * w0 / b_jm1;
+            const double nu = -b_j / b_jm2;
+            const double mu_t = 2.0 * b_j * w1 / b_jm1;
+            const double gamma_t = -(1.0 - b_jm1 * tj_m1) * mu_t;
+
+            evaluate_rhs(work.stage_prev, work.rhs);
+            work.u_new = (1.0 - mu - nu) * u + mu * work.stage_prev + nu * work.stage_prev2
+                       + (mu_t * h) * work.rhs + (gamma_t * h) * work.f0;
+            work.stage_prev2.swap(work.stage_prev);
+            work.stage_prev.swap(work.u_new);
+
+            b_jm2 = b_jm1; b_jm1 = b_j;
+            tj_m2 = tj_m1; tj_m1 = tj;
+            dtj_m2 = dtj_m1; dtj_m1 = dtj;
+            ddtj_m2 = ddtj_m1; ddtj_m1 = ddtj;
+        }
+        work.u_new.swap(work.stage_prev);  // Y_s
+    }
+
+    // Residual of the theta scheme at v, R(v) = M (v - u) + th h N(v) + work.Ku_old
+    void theta_residual(const VectorXd& v, double h, double th, VectorXd& R) {
+        work.rhs = v - u;
+        M.multiply(work.rhs, R);
+        apply_operator(v, work.Ku);
+        R += th * h * work.Ku + work.Ku_old;
+    }
+
+    // Theta-scheme step of size h: solve R(v) = M (v - u) + h [th N(v) + (1 - th) N(u)] = 0, where
+    // N(v) = K(v) v - F(v), with Newton's method on the tridiagonal Jacobian M + th h dN/dv.
+    // th = 1 is backward Euler, th = 1/2 Crank-Nicolson. Each update is damped by backtracking
+    // (halving the step length until ||R|| decreases by the Armijo condition), which keeps
+    // Newton convergent from the previous time level on steep fronts and degenerate laws.
+    // Returns false if Newton fails to converge.
+    bool step_theta(double h, double th) {
+        if (th < 1.0) {
+            apply_operator(u, work.Ku_old);
+            work.Ku_old *= (1.0 - th) * h;  // Explicit part, fixed during the iterations
+        } else {
+            work.Ku_old.setZero();
+        }
+        work.u_new = u;  // Initial guess: previous time level
+        theta_residual(work.u_new, h, th, work.residual);
+        double r_norm = work.residual.norm();
+        for (int it = 0; it < newton_max_iter; ++it) {
+            apply_operator_jacobian(work.u_new, work.J);
+            work.J.lower = M.lower + th * h * work.J.lower;
+            work.J.diag = M.diag + th * h * work.J.diag;
+            work.J.upper = M.upper + th * h * work.J.upper;
+            if (backend == LinearSolverBackend::Partitioned) {
+                work.J_plu.compute(work.J);
+                work.J_plu.solve(work.residual, work.delta);
+            } else {
+                work.J_lu.compute(work.J);
+                work.J_lu.solve(work.residual, work.delta);
+            }
+            if (work.delta.lpNorm<Infinity>() <= newton_tol * (1.0 + work.u_new.lpNorm<Infinity>())) {
+                work.u_new -= work.delta;
+                return true;
+            }
+            double lambda = 1.0, r_trial = 0.0;
+            for (int k = 0; k <= newton_max_backtracks; ++k, lambda *= 0.5) {
+                work.u_trial = work.u_new - lambda * work.delta;
+                theta_residual(work.u_trial, h, th, work.residual_trial);
+                r_trial = work.residual_trial.norm();
+                if (r_trial <= (1.0 - 1e-4 * lambda) * r_norm) break;  // Sufficient decrease
+            }
+            work.u_new.swap(work.u_trial);  // The shortest step is taken if none decreased ||R||
+            work.residual.swap(work.residual_trial);
+            r_norm = r_trial;
+        }
+        return false;
+    }
+
+    // Advance u by one step of size h of the selected integrator into work.u_new
+    bool step(double h) {
+        switch (integrator) {
+        case TimeIntegrator::BackwardEuler: return step_theta(h, 1.0);
+        case TimeIntegrator::CrankNicolson: return step_theta(h, 0.5);
+        case TimeIntegrator::Theta: return step_theta(h, theta);
+        case TimeIntegrator::RKC: step_rkc(h); return true;
+        case TimeIntegrator::ForwardEuler: break;
+        }
+        step_forward_euler(h);
+        return true;
+    }
+
+    // Forward Euler over one step of size dt under the stability control: the step is
+    // clamped to the stable size, or split into equal sub-steps that each respect it.
+    // The stable size is re-estimated from the current solution at every step.
+    void advance_forward_euler_stable() {
+        const double h_stable = stable_time_step(u);
+        int substeps = 1;
+        double h = dt;
+        if (stability == StabilityControl::Clamp) {
+            h = min(dt, h_stable);
+        } else if (dt > h_stable) {
+            substeps = static_cast<int>(ceil(dt / h_stable));
+            h = dt / substeps;
+        }
+        for (int k = 0; k < substeps; ++k) {
+            step_forward_euler(h);
+            apply_boundary_conditions(work.u_new);
+            u.swap(work.u_new);
+        }
+    }
+
+    // Hook called by solve() before the (allocation-free) time loop: derived solvers build
+    // mesh-dependent data here
+    virtual void prepare_time_loop() {}
+
+    // Per-element bound on D(u) entering the spectral radius estimate; by default the
+    // element average, which bounds the Galerkin operator
+    virtual void element_diffusion_bound(const VectorXd& u_in, VectorXd& d_elem) { element_diffusion(u_in, d_elem); }
+
+    // Order of accuracy in time of the selected integrator
+    int integrator_order() const {
+        if (integrator == TimeIntegrator::CrankNicolson || integrator == TimeIntegrator::RKC) return 2;
+        if (integrator == TimeIntegrator::Theta && theta == 0.5) return 2;
+        return 1;
+    }
+
+    // One step of size h followed by boundary conditions, result swapped into u
+    bool advance(double h) {
+        if (!step(h)) return false;
+        apply_boundary_conditions(work.u_new);
+        u.swap(work.u_new);
+        return true;
+    }
+
+    // Advance by h; if Newton fails, retry as two steps of h / 2, halving at most halvings
+    // times. u only changes when a (sub-)step succeeds, so a retry needs no restore.
+    bool advance_halving(double h, int halvings) {
+        if (advance(h)) return true;
+        if (halvings == 0) return false;
+        return advance_halving(0.5 * h, halvings - 1) && advance_halving(0.5 * h, halvings - 1);
+    }
+
+    // Adaptive integration to adapt.t_end. Each step is taken once with size h and twice
+    // with h / 2; the difference estimates the local error (Richardson). A PI controller
+    // picks the next h, and steps with a scaled RMS error above 1 are rejected and retried.
+    // The first trial step is dt; dt itself is left unchanged.
+    void solve_adaptive() {
+        const int order = integrator_order();
+        const double k = order + 1.0;
+        const double alpha = 0.7 / k, beta = 0.4 / k;  // PI controller gains
+        double t = 0.0, h = dt, err_prev = 1.0;
+        adapt.accepted = adapt.rejected = 0;
+        while (t < adapt.t_end) {
+            const bool last = t + h >= adapt.t_end;
+            if (last) h = adapt.t_end - t;
+            if (h <= 1e-14 * adapt.t_end) {
+                throw runtime_error("FEMSolver: adaptive step size underflow");
+            }
+            work.u_start = u;
+            bool ok = advance(h);  // One full step
+            work.u_single = u;
+            u = work.u_start;
+            ok = ok && advance(0.5 * h) && advance(0.5 * h);  // Two half steps
+
+            double err = numeric_limits<double>::infinity();
+            if (ok) {
+                double sum = 0.0;
+                for (int i = 0; i < nx; ++i) {
+                    double scale = adapt.atol + adapt.rtol * max(fabs(u[i]), fabs(work.u_single[i]));
+                    double e = (u[i] - work.u_single[i]) / ((pow(2.0, order) - 1.0) * scale);
+                    sum += e * e;
+                }
+                err = sqrt(sum / nx);
+            }
+
+            if (err <= 1.0) {
+                t = last ? adapt.t_end : t + h;
+                ++adapt.accepted;
+                double factor = adapt.safety * pow(max(err, 1e-10), -alpha) * pow(err_prev, beta);
+                h *= min(adapt.max_factor, max(adapt.min_factor, factor));
+                err_prev = max(err, 1e-4);
+                if (amr.enabled && adapt.accepted % amr.interval == 0) adapt_mesh();
+                if (moving.enabled && adapt.accepted % moving.interval == 0) move_mesh();
+            } else {
+                u = work.u_start;  // Reject: restore and retry with a smaller step
+                ++adapt.rejected;
+                double factor = ok ? adapt.safety * pow(err, -1.0 / k) : 0.25;
+                h *= max(adapt.min_factor, factor);
+            }
+        }
+    }
+
+public:
+
+    // Function to run the simulation (solving the system over time). The loop
+    // performs no heap allocation outside remesh events: build with
+    // -DEIGEN_RUNTIME_NO_MALLOC to have Eigen assert if that ever changes.
     void solve() override {
+        if (!mass_factorized) factorize_mass();
+        prepare_time_loop();
+        NoMallocScope no_malloc(backend != LinearSolverBackend::DenseQR);  // Dense QR is verification-only
+        amr.remeshes = amr.refined = amr.coarsened = 0;
+        moving.moves = 0;
+        if (adapt.enabled) {
+            solve_adaptive();
+            return;
+        }
+        const bool stabilize = integrator == TimeIntegrator::ForwardEuler && stability != StabilityControl::None;
         for (int n = 0; n < nt; ++n) {
-            MatrixXd K = assemble_stiffness_matrix();
-            VectorXd rhs = M * u;
-            VectorXd u_new = M.colPivHouseholderQr().solve(rhs - dt * K * u);
-            apply_boundary_conditions(u_new);
-            u = u_new;
+            if (amr.enabled && n % amr.interval == 0) adapt_mesh();  // The only allocating events
+            if (moving.enabled && n % moving.interval == 0) move_mesh();
+            if (stabilize) {
+                advance_forward_euler_stable();
+                continue;
+            }
+            if (!advance_halving(dt, max_step_halvings)) {
+                throw runtime_error("FEMSolver: Newton iteration did not converge, even with the step halved");
+            }
         }
     }
 
     // Display the solution
     void display_solution() override {
         for (int i = 0; i < nx; ++i) {
-            cout << "x[" << i << "] = " << i * dx << ", u[" << i << "] = " << u[i] << endl;
+            cout << "x[" << i << "] = " << x[i] << ", u[" << i << "] = " << u[i] << endl;
         }
     }
 };
 
-// NonlinearDiffusionSolver class inherits from FEMSolver, handling nonlinear-specific logic
-class NonlinearDiffusionSolver : public FEMSolver {
+// Diffusion laws: literal functor types providing D(u) and its analytic derivative dD(u)
+// for DiffusionSolver<Law>. Laws built only from arithmetic are usable in constant
+// expressions; those needing exp or pow (not constexpr in C++17) are plain inline functions.
+
+// LinearDiffusion: D(u) = a + b u
+struct LinearDiffusion {
+    double a = 1.0;  // D(0)
+    double b = 0.5;  // dD/du
+
+    constexpr double D(double u) const { return a + b * u; }
+    constexpr double dD(double /*u*/) const { return b; }
+    constexpr double Phi(double u) const { return (a + 0.5 * b * u) * u; }  // Kirchhoff potential int_0^u D
+};
+
+// PowerLawDiffusion: Porous-medium law D(u) = D0 u^m for u >= 0 (zero below)
+struct PowerLawDiffusion {
+    double D0 = 1.0;  // D at u = 1
+    double m = 2.0;   // Exponent
+
+    double D(double u) const { return u > 0.0 ? D0 * pow(u, m) : 0.0; }
+    double dD(double u) const { return u > 0.0 ? D0 * m * pow(u, m - 1.0) : 0.0; }
+    double Phi(double u) const { return u > 0.0 ? D0 * pow(u, m + 1.0) / (m + 1.0) : 0.0; }  // int_0^u D
+};
+
+// ExponentialDiffusion: D(u) = D0 exp(beta u)
+struct ExponentialDiffusion {
+    double D0 = 1.0;    // D(0)
+    double beta = 1.0;  // Growth rate
+
+    double D(double u) const { return D0 * exp(beta * u); }
+    double dD(double u) const { return beta * D0 * exp(beta * u); }
+    double Phi(double u) const { return beta != 0.0 ? D0 * expm1(beta * u) / beta : D0 * u; }  // int_0^u D
+};
+
+// ArrheniusDiffusion: D(u) = D0 exp(-T_a / u) with u an absolute temperature and
+// T_a = E_a / R the activation temperature
+struct ArrheniusDiffusion {
+    double D0 = 1.0;                   // Pre-exponential factor
+    double activation_temperature = 1.0;  // E_a / R
+
+    double D(double u) const { return D0 * exp(-activation_temperature / u); }
+    double dD(double u) const { return D(u) * activation_temperature / (u * u); }
+};
+
+// TabulatedDiffusion: D given at N equally spaced values of u on [u_min, u_max],
+// interpolated linearly and held constant outside the table
+template <size_t N>
+struct TabulatedDiffusion {
+    static_assert(N >= 2, "a diffusion table needs at least two entries");
+    double u_min = 0.0;
+    double u_max = 1.0;
+    array<double, N> values{};  // D(u_min + k (u_max - u_min) / (N - 1))
+
+    // Interval index and local coordinate in [0, 1] of u, clamped to the table
+    constexpr size_t locate(double u, double& t) const {
+        const double s = (u - u_min) / (u_max - u_min) * (N - 1);
+        if (!(s > 0.0)) {
+            t = 0.0;
+            return 0;
+        }
+        if (s >= N - 1) {
+            t = 1.0;
+            return N - 2;
+        }
+        const size_t k = static_cast<size_t>(s);
+        t = s - k;
+        return k;
+    }
+
+    constexpr double D(double u) const {
+        double t = 0.0;
+        const size_t k = locate(u, t);
+        return values[k] + t * (values[k + 1] - values[k]);
+    }
+
+    constexpr double dD(double u) const {
+        if (u < u_min || u > u_max) return 0.0;
+        double t = 0.0;
+        const size_t k = locate(u, t);
+        return (values[k + 1] - values[k]) * (N - 1) / (u_max - u_min);
+    }
+};
+
+// MonotoneSplineDiffusion: D through measured samples (u_k, D_k), interpolated by a
+// monotone piecewise cubic Hermite spline (Fritsch-Carlson slopes), so monotone data give
+// a monotone D without overshoot; D is held constant outside the table. Every interval
+// stores its cubic, derivative and Kirchhoff-potential coefficients, precomputed once, so
+// an evaluation is an interval lookup plus a Horner sum. On uniformly spaced samples the
+// lookup is a clamped multiply; otherwise it is a binary search.
+class MonotoneSplineDiffusion {
+    vector<double> knots;           // u_k, strictly increasing
+    vector<double> inv_h;           // 1 / (u_{k+1} - u_k)
+    vector<double> c0, c1, c2, c3;  // D = c0 + c1 t + c2 t^2 + c3 t^3, t = (u - u_k) / h_k
+    vector<double> d0, d1, d2;      // dD/du = d0 + d1 t + d2 t^2
+    vector<double> phi_knot;        // Phi(u_k) = int_{u_0}^{u_k} D
+    double uniform_inv_h = 0.0;     // 1 / h for uniform samples, 0 otherwise
+
+    // Interval index of u, clamped to the table
+    int locate(double u) const {
+        const int last = static_cast<int>(knots.size()) - 2;
+        if (uniform_inv_h > 0.0) {
+            const double s = (u - knots[0]) * uniform_inv_h;
+            return static_cast<int>(min(max(s, 0.0), static_cast<double>(last)));
+        }
+        return static_cast<int>(upper_bound(knots.begin() + 1, knots.end() - 1, u) - knots.begin()) - 1;
+    }
+
+    // Local coordinate of u in interval k, clamped to [0, 1]
+    double local(int k, double u) const { return min(max((u - knots[k]) * inv_h[k], 0.0), 1.0); }
+
 public:
-    NonlinearDiffusionSolver(int nx_, double L_, double dt_, int nt_)
-        : FEMSolver(nx_, L_, dt_, nt_) {}
+    MonotoneSplineDiffusion(const vector<double>& u_samples, const vector<double>& D_samples)
+        : knots(u_samples) {
+        const int n = static_cast<int>(knots.size());
+        if (n < 2 || static_cast<int>(D_samples.size()) != n) {
+            throw invalid_argument("MonotoneSplineDiffusion: need at least two (u, D) samples");
+        }
+        vector<double> h(n - 1), delta(n - 1), m(n);
+        for (int k = 0; k < n - 1; ++k) {
+            h[k] = knots[k + 1] - knots[k];
+            if (!(h[k] > 0.0)) {
+                throw invalid_argument("MonotoneSplineDiffusion: samples must be strictly increasing in u");
+            }
+            delta[k] = (D_samples[k + 1] - D_samples[k]) / h[k];
+        }
+
+        // Fritsch-Carlson slopes: weighted harmonic mean of the secants, zero at extrema
+        m[0] = delta[0];
+        m[n - 1] = delta[n - 2];
+        for (int k = 1; k < n - 1; ++k) {
+            if (delta[k - 1] * delta[k] <= 0.0) {
+                m[k] = 0.0;
+            } else {
+                const double w1 = 2.0 * h[k] + h[k - 1];
+                const double w2 = h[k] + 2.0 * h[k - 1];
+                m[k] = (w1 + w2) / (w1 / delta[k - 1] + w2 / delta[k]);
+            }
+        }
+
+        inv_h.resize(n - 1);
+        c0.resize(n - 1); c1.resize(n - 1); c2.resize(n - 1); c3.resize(n - 1);
+        d0.resize(n - 1); d1.resize(n - 1); d2.resize(n - 1);
+        phi_knot.assign(n, 0.0);
+        for (int k = 0; k < n - 1; ++k) {
+            const double dD = D_samples[k + 1] - D_samples[k];
+            const double m0 = m[k] * h[k], m1 = m[k + 1] * h[k];
+            inv_h[k] = 1.0 / h[k];
+            c0[k] = D_samples[k];
+            c1[k] = m0;
+            c2[k] = 3.0 * dD - 2.0 * m0 - m1;
+            c3[k] = -2.0 * dD + m0 + m1;
+            d0[k] = c1[k] * inv_h[k];
+            d1[k] = 2.0 * c2[k] * inv_h[k];
+            d2[k] = 3.0 * c3[k] * inv_h[k];
+            phi_knot[k + 1] = phi_knot[k] + h[k] * (c0[k] + c1[k] / 2.0 + c2[k] / 3.0 + c3[k] / 4.0);
+        }
+
+        const double h_mean = (knots[n - 1] - knots[0]) / (n - 1);
+        bool uniform = true;
+        for (int k = 0; k < n - 1; ++k) {
+            uniform = uniform && abs(h[k] - h_mean) <= 1e-12 * h_mean;
+        }
+        uniform_inv_h = uniform ? 1.0 / h_mean : 0.0;
+    }
+
+    double D(double u) const {
+        const int k = locate(u);
+        const double t = local(k, u);
+        return c0[k] + t * (c1[k] + t * (c2[k] + t * c3[k]));
+    }
+
+    double dD(double u) const {
+        if (u < knots.front() || u > knots.back()) return 0.0;
+        const int k = locate(u);
+        const double t = local(k, u);
+        return d0[k] + t * (d1[k] + t * d2[k]);
+    }
+
+    // Kirchhoff potential, measured from the first sample: the additive constant does not
+    // change the Laplacian of Phi
+    double Phi(double u) const {
+        const int k = locate(u);
+        const double t = local(k, u);
+        const double width = knots[k + 1] - knots[k];
+        const double value = phi_knot[k] + width * t * (c0[k] + t * (c1[k] / 2.0 + t * (c2[k] / 3.0 + t * c3[k] / 4.0)));
+        // Linear continuation with the held end values of D outside the table
+        if (u < knots.front()) return value + c0.front() * (u - knots.front());
+        if (u > knots.back()) return value + D(u) * (u - knots.back());
+        return value;
+    }
+};
+
+// ExpressionDiffusion: D(u) given at run time as a formula, e.g. "D = 1 + 0.5*u + 0.1*u^2".
+// The formula is parsed once and compiled to a short register bytecode, with constant
+// subexpressions folded and constant operands carried inside the instructions. evaluate()
+// runs the program over whole arrays of u, each instruction sweeping a block of values, so
+// the interpretation cost is paid per block rather than per point; dD/du comes out of the
+// same sweep as the dual part of every register.
+// Grammar: numbers, u, + - * / ^ (right associative), unary minus, parentheses and the
+// functions exp, log, sqrt, tanh.
+class ExpressionDiffusion {
+public:
+    static constexpr int max_registers = 16;  // Registers available to the compiled program
+    static constexpr int block = 64;          // Values processed per instruction sweep
+
+private:
+    enum class Op : unsigned char {
+        Const, U,                       // Load constant c / the argument u
+        Add, Sub, Mul, Div, Pow,        // dst = a op b
+        AddC, MulC, RSubC, RDivC, PowC, // dst = a + c, a * c, c - a, c / a, a ^ c
+        Neg, Exp, Log, Sqrt, Tanh       // dst = f(a)
+    };
+    struct Instruction {
+        Op op;
+        unsigned char dst = 0, a = 0, b = 0;  // Register indices
+        double c = 0.0;                       // Constant operand
+    };
+    struct Node {  // Expression tree node produced by the parser
+        Op op;
+        int left = -1, right = -1;  // Operand nodes
+        double value = 0.0;         // Value of a Const node
+    };
+
+    string source;                // Formula as given
+    vector<Instruction> program;  // Compiled bytecode, result in register 0
+    int n_registers = 0;          // Registers used by the program
+
+    // Recursive-descent parser building a constant-folded expression tree
+    struct Parser {
+        const string& s;
+        size_t pos = 0;
+        vector<Node> nodes;
+
+        explicit Parser(const string& s_) : s(s_) {}
+
+        [[noreturn]] void fail(const string& what) const {
+            throw invalid_argument("ExpressionDiffusion: " + what + " at position " + to_string(pos) +
+                                   " in \"" + s + "\"");
+        }
+        void skip_space() {
+            while (pos < s.size() && isspace(static_cast<unsigned char>(s[pos]))) ++pos;
+        }
+        bool accept(char c) {
+            skip_space();
+            if (pos < s.size() && s[pos] == c) {
+                ++pos;
+                return true;
+            }
+            return false;
+        }
+        int add(Op op, int left = -1, int right = -1, double value = 0.0) {
+            nodes.push_back(Node{op, left, right, value});
+            return static_cast<int>(nodes.size()) - 1;
+        }
+        bool is_const(int n) const { return nodes[n].op == Op::Const; }
+
+        int unary_node(Op op, int a) {
+            if (!is_const(a)) return add(op, a);
+            const double x = nodes[a].value;
+            switch (op) {
+            case Op::Neg: return add(Op::Const, -1, -1, -x);
+            case Op::Exp: return add(Op::Const, -1, -1, exp(x));
+            case Op::Log: return add(Op::Const, -1, -1, log(x));
+            case Op::Sqrt: return add(Op::Const, -1, -1, sqrt(x));
+            default: return add(Op::Const, -1, -1, tanh(x));
+            }
+        }
+        int binary_node(Op op, int a, int b) {
+            if (!is_const(a) || !is_const(b)) return add(op, a, b);
+            const double x = nodes[a].value, y = nodes[b].value;
+            switch (op) {
+            case Op::Add: return add(Op::Const, -1, -1, x + y);
+            case Op::Sub: return add(Op::Const, -1, -1, x - y);
+            case Op::Mul: return add(Op::Const, -1, -1, x * y);
+            case Op::Div: return add(Op::Const, -1, -1, x / y);
+            default: return add(Op::Const, -1, -1, pow(x, y));
+            }
+        }
+
+        int expression() {
+            int n = term();
+            for (;;) {
+                if (accept('+')) n = binary_node(Op::Add, n, term());
+                else if (accept('-')) n = binary_node(Op::Sub, n, term());
+                else return n;
+            }
+        }
+        int term() {
+            int n = unary();
+            for (;;) {
+                if (accept('*')) n = binary_node(Op::Mul, n, unary());
+                else if (accept('/')) n = binary_node(Op::Div, n, unary());
+                else return n;
+            }
+        }
+        int unary() {
+            if (accept('-')) return unary_node(Op::Neg, unary());
+            if (accept('+')) return unary();
+            const int base = primary();
+            return accept('^') ? binary_node(Op::Pow, base, unary()) : base;
+        }
+        int primary() {
+            skip_space();
+            if (accept('(')) {
+                const int n = expression();
+                if (!accept(')')) fail("expected ')'");
+                return n;
+            }
+            if (pos < s.size() && (isdigit(static_cast<unsigned char>(s[pos])) || s[pos] == '.')) {
+                const char* begin = s.c_str() + pos;
+                char* end = nullptr;
+                const double value = strtod(begin, &end);
+                if (end == begin) fail("malformed number");
+                pos += end - begin;
+                return add(Op::Const, -1, -1, value);
+            }
+            size_t start = pos;
+            while (pos < s.size() && isalpha(static_cast<unsigned char>(s[pos]))) ++pos;
+            const string name = s.substr(start, pos - start);
+            if (name == "u") return add(Op::U);
+            Op op;
+            if (name == "exp") op = Op::Exp;
+            else if (name == "log") op = Op::Log;
+            else if (name == "sqrt") op = Op::Sqrt;
+            else if (name == "tanh") op = Op::Tanh;
+            else {
+                pos = start;
+                fail(name.empty() ? "expected an operand" : "unknown name '" + name + "'");
+            }
+            if (!accept('(')) fail("expected '(' after " + name);
+            const int arg = expression();
+            if (!accept(')')) fail("expected ')'");
+            return unary_node(op, arg);
+        }
+    };
+
+    // Emit the code of node n, leaving its value in register reg
+    void emit(const vector<Node>& nodes, int n, int reg) {
+        if (reg >= max_registers) {
+            throw invalid_argument("ExpressionDiffusion: expression too deeply nested in \"" + source + "\"");
+        }
+        n_registers = max(n_registers, reg + 1);
+        const auto r = static_cast<unsigned char>(reg);
+        const Node& node = nodes[n];
+        switch (node.op) {
+        case Op::Const: program.push_back({Op::Const, r, 0, 0, node.value}); return;
+        case Op::U: program.push_back({Op::U, r}); return;
+        case Op::Neg: case Op::Exp: case Op::Log: case Op::Sqrt: case Op::Tanh:
+            emit(nodes, node.left, reg);
+            program.push_back({node.op, r, r});
+            return;
+        default: break;
+        }
+
+        // Binary operation: fold a constant operand into the instruction where possible
+        const Node& left = nodes[node.left];
+        const Node& right = nodes[node.right];
+        if (right.op == Op::Const) {
+            const double c = right.value;
+            emit(nodes, node.left, reg);
+            switch (node.op) {
+            case Op::Add: program.push_back({Op::AddC, r, r, 0, c}); return;
+            case Op::Sub: program.push_back({Op::AddC, r, r, 0, -c}); return;
+            case Op::Mul: program.push_back({Op::MulC, r, r, 0, c}); return;
+            case Op::Div: program.push_back({Op::MulC, r, r, 0, 1.0 / c}); return;
+            default:
+                if (c == 2.0) program.push_back({Op::Mul, r, r, r});
+                else program.push_back({Op::PowC, r, r, 0, c});
+                return;
+            }
+        }
+        if (left.op == Op::Const && node.op != Op::Pow) {
+            const double c = left.value;
+            emit(nodes, node.right, reg);
+            switch (node.op) {
+            case Op::Add: program.push_back({Op::AddC, r, r, 0, c}); return;
+            case Op::Sub: program.push_back({Op::RSubC, r, r, 0, c}); return;
+            case Op::Mul: program.push_back({Op::MulC, r, r, 0, c}); return;
+            default: program.push_back({Op::RDivC, r, r, 0, c}); return;
+            }
+        }
+        emit(nodes, node.left, reg);
+        emit(nodes, node.right, reg + 1);
+        program.push_back({node.op, r, r, static_cast<unsigned char>(reg + 1)});
+    }
+
+    // Run the program over n values; each register holds a value and, with derivative,
+    // its derivative with respect to u
+    template <bool with_derivative>
+    void run(const double* u, double* D_out, double* dD_out, int n) const {
+        double val[max_registers][block];
+        double der[max_registers][block];
+        for (int start = 0; start < n; start += block) {
+            const int m = min(block, n - start);
+            const double* x = u + start;
+            for (const Instruction& ins : program) {
+                double* v = val[ins.dst];
+                double* dv = der[ins.dst];
+                const double* a = val[ins.a];
+                const double* da = der[ins.a];
+                const double* b = val[ins.b];
+                const double* db = der[ins.b];
+                const double c = ins.c;
+                switch (ins.op) {
+                case Op::Const:
+                    for (int i = 0; i < m; ++i) v[i] = c;
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = 0.0;
+                    break;
+                case Op::U:
+                    for (int i = 0; i < m; ++i) v[i] = x[i];
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = 1.0;
+                    break;
+                case Op::Add:
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = da[i] + db[i];
+                    for (int i = 0; i < m; ++i) v[i] = a[i] + b[i];
+                    break;
+                case Op::Sub:
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = da[i] - db[i];
+                    for (int i = 0; i < m; ++i) v[i] = a[i] - b[i];
+                    break;
+                case Op::Mul:
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = da[i] * b[i] + a[i] * db[i];
+                    for (int i = 0; i < m; ++i) v[i] = a[i] * b[i];
+                    break;
+                case Op::Div:
+                    for (int i = 0; i < m; ++i) {
+                        const double q = a[i] / b[i];
+                        if (with_derivative) dv[i] = (da[i] - q * db[i]) / b[i];
+                        v[i] = q;
+                    }
+                    break;
+                case Op::Pow:
+                    for (int i = 0; i < m; ++i) {
+                        const double p = pow(a[i], b[i]);
+                        if (with_derivative) dv[i] = p * (db[i] * log(a[i]) + b[i] * da[i] / a[i]);
+                        v[i] = p;
+                    }
+                    break;
+                case Op::AddC:
+                    for (int i = 0; i < m; ++i) v[i] = a[i] + c;
+                    if (with_derivative && dv != da) for (int i = 0; i < m; ++i) dv[i] = da[i];
+                    break;
+                case Op::MulC:
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = c * da[i];
+                    for (int i = 0; i < m; ++i) v[i] = c * a[i];
+                    break;
+                case Op::RSubC:
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = -da[i];
+                    for (int i = 0; i < m; ++i) v[i] = c - a[i];
+                    break;
+                case Op::RDivC:
+                    for (int i = 0; i < m; ++i) {
+                        const double q = c / a[i];
+                        if (with_derivative) dv[i] = -q * da[i] / a[i];
+                        v[i] = q;
+                    }
+                    break;
+                case Op::PowC:
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = c * pow(a[i], c - 1.0) * da[i];
+                    for (int i = 0; i < m; ++i) v[i] = pow(a[i], c);
+                    break;
+                case Op::Neg:
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = -da[i];
+                    for (int i = 0; i < m; ++i) v[i] = -a[i];
+                    break;
+                case Op::Exp:
+                    for (int i = 0; i < m; ++i) {
+                        const double e = exp(a[i]);
+                        if (with_derivative) dv[i] = e * da[i];
+                        v[i] = e;
+                    }
+                    break;
+                case Op::Log:
+                    if (with_derivative) for (int i = 0; i < m; ++i) dv[i] = da[i] / a[i];
+                    for (int i = 0; i < m; ++i) v[i] = log(a[i]);
+                    break;
+                case Op::Sqrt:
+                    for (int i = 0; i < m; ++i) {
+                        const double r = sqrt(a[i]);
+                        if (with_derivative) dv[i] = 0.5 * da[i] / r;
+                        v[i] = r;
+                    }
+                    break;
+                case Op::Tanh:
+                    for (int i = 0; i < m; ++i) {
+                        const double t = tanh(a[i]);
+                        if (with_derivative) dv[i] = (1.0 - t * t) * da[i];
+                        v[i] = t;
+                    }
+                    break;
+                }
+            }
+            copy(val[0], val[0] + m, D_out + start);
+            if (with_derivative) copy(der[0], der[0] + m, dD_out + start);
+        }
+    }
+
+public:
+    // Compile a formula in u, optionally prefixed by "D ="
+    explicit ExpressionDiffusion(const string& formula = "1 + 0.5*u") : source(formula) {
+        Parser parser(source);
+        const size_t eq = source.find('=');
+        if (eq != string::npos) {
+            const size_t lhs = source.find_first_not_of(" \t", 0);
+            if (source.compare(lhs, 1, "D") != 0 || source.find_first_not_of(" \t", lhs + 1) != eq) {
+                throw invalid_argument("ExpressionDiffusion: expected \"D = <expression in u>\", got \"" + source + "\"");
+            }
+            parser.pos = eq + 1;
+        }
+        const int root = parser.expression();
+        parser.skip_space();
+        if (parser.pos != source.size()) parser.fail("unexpected '" + string(1, source[parser.pos]) + "'");
+        emit(parser.nodes, root, 0);
+    }
+
+    // D and, if dD_out is not null, dD/du at n values of u
+    void evaluate(const double* u, double* D_out, double* dD_out, int n) const {
+        if (dD_out) run<true>(u, D_out, dD_out, n);
+        else run<false>(u, D_out, nullptr, n);
+    }
+
+    double D(double u) const {
+        double d;
+        run<false>(&u, &d, nullptr, 1);
+        return d;
+    }
+
+    double dD(double u) const {
+        double d, dd;
+        run<true>(&u, &d, &dd, 1);
+        return dd;
+    }
+
+    const string& formula() const { return source; }
+    int instruction_count() const { return static_cast<int>(program.size()); }
+};
+
+// PluginLibrary: A shared object providing a diffusion law and/or a source term through the
+// C ABI of fem_plugin.h, loaded with dlopen. The library stays loaded while this object
+// lives, so it must outlive every solver using the plugin.
+class PluginLibrary {
+    void* handle = nullptr;           // dlopen handle
+    const FemPlugin* table = nullptr; // Entry points exported by the plugin
+
+    // SourceTerm adaptor: the batch entry point if provided, scalar calls otherwise
+    static void evaluate_source(void* context, const double* x, const double* u, double* f, double* df_du, int n) {
+        const FemPlugin* p = static_cast<const FemPlugin*>(context);
+        if (p->source_batch) {
+            p->source_batch(x, u, f, df_du, n);
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            f[i] = p->source(x[i], u[i]);
+            if (df_du) df_du[i] = p->source_derivative(x[i], u[i]);
+        }
+    }
+
+public:
+    PluginLibrary() = default;
+    explicit PluginLibrary(const string& path) { open(path); }
+    ~PluginLibrary() { close(); }
+    PluginLibrary(const PluginLibrary&) = delete;
+    PluginLibrary& operator=(const PluginLibrary&) = delete;
+
+    // Load a plugin and check its table against the ABI version this solver was built with
+    void open(const string& path) {
+        close();
+        handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle) throw runtime_error(string("PluginLibrary: ") + dlerror());
+        auto entry = reinterpret_cast<FemPluginEntry>(dlsym(handle, FEM_PLUGIN_ENTRY));
+        table = entry ? entry() : nullptr;
+        string error;
+        if (!entry) {
+            error = "does not export " FEM_PLUGIN_ENTRY "()";
+        } else if (!table) {
+            error = "returned no plugin table";
+        } else if (table->abi_version != FEM_PLUGIN_ABI_VERSION) {
+            error = "was built for plugin ABI version " + to_string(table->abi_version) +
+                    ", expected " + to_string(FEM_PLUGIN_ABI_VERSION);
+        } else if (!table->diffusion != !table->diffusion_derivative) {
+            error = "must provide diffusion and diffusion_derivative together";
+        } else if (!table->source != !table->source_derivative) {
+            error = "must provide source and source_derivative together";
+        }
+        if (!error.empty()) {
+            close();
+            throw runtime_error("PluginLibrary: " + path + " " + error);
+        }
+    }
+
+    void close() {
+        if (handle) dlclose(handle);
+        handle = nullptr;
+        table = nullptr;
+    }
+
+    bool has_diffusion() const { return table && (table->diffusion || table->diffusion_batch); }
+    bool has_source() const { return table && (table->source || table->source_batch); }
+
+    const FemPlugin& plugin() const {
+        if (!table) throw runtime_error("PluginLibrary: no plugin loaded");
+        return *table;
+    }
+
+    // Source term for FEMSolver::set_source(); empty if the plugin provides none
+    SourceTerm source_term() const {
+        SourceTerm s;
+        if (has_source()) {
+            s.evaluate = evaluate_source;
+            s.context = const_cast<FemPlugin*>(table);
+        }
+        return s;
+    }
+};
+
+// PluginDiffusion: The diffusion law of a loaded plugin. The batch entry point, when the
+// plugin has one, serves evaluate() and with it the element kernels; D and dD prefer the
+// scalar entry points.
+class PluginDiffusion {
+    const FemPlugin* plugin;  // Entry points, owned by the PluginLibrary
+
+public:
+    explicit PluginDiffusion(const PluginLibrary& library) : plugin(&library.plugin()) {
+        if (!library.has_diffusion()) {
+            throw invalid_argument(string("PluginDiffusion: plugin ") + (plugin->name ? plugin->name : "") +
+                                   " provides no diffusion law");
+        }
+    }
+
+    void evaluate(const double* u, double* D_out, double* dD_out, int n) const {
+        if (plugin->diffusion_batch) {
+            plugin->diffusion_batch(u, D_out, dD_out, n);
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            D_out[i] = plugin->diffusion(u[i]);
+            if (dD_out) dD_out[i] = plugin->diffusion_derivative(u[i]);
+        }
+    }
+
+    double D(double u) const {
+        if (plugin->diffusion) return plugin->diffusion(u);
+        double d;
+        plugin->diffusion_batch(&u, &d, nullptr, 1);
+        return d;
+    }
+
+    double dD(double u) const {
+        if (plugin->diffusion_derivative) return plugin->diffusion_derivative(u);
+        double d, dd;
+        plugin->diffusion_batch(&u, &d, &dd, 1);
+        return dd;
+    }
+};
+
+// Laws with a closed-form Kirchhoff potential Phi(u) = int_0^u D(s) ds can run in
+// StiffnessMode::Kirchhoff
+template <class Law, class = void>
+struct has_kirchhoff_potential : false_type {};
+template <class Law>
+struct has_kirchhoff_potential<Law, void_t<decltype(declval<const Law&>().Phi(0.0))>> : true_type {};
+
+// Laws providing evaluate(u, D, dD, n) are evaluated a block of quadrature points at a time
+// instead of point by point
+template <class Law, class = void>
+struct has_batch_evaluation : false_type {};
+template <class Law>
+struct has_batch_evaluation<Law, void_t<decltype(declval<const Law&>().evaluate(
+    declval<const double*>(), declval<double*>(), declval<double*>(), 0))>> : true_type {};
+
+static_assert(LinearDiffusion{1.0, 0.5}.D(2.0) == 2.0, "diffusion laws must be constexpr-evaluable");
+static_assert(TabulatedDiffusion<3>{0.0, 2.0, {1.0, 2.0, 4.0}}.D(1.5) == 3.0,
+              "diffusion laws must be constexpr-evaluable");
+
+// DiffusionSolver class inherits from FEMSolver, handling nonlinear-specific logic for a
+// diffusion law known at compile time. Law is a functor type providing D(u) and dD(u);
+// both inline into the element kernels. Runtime polymorphism stays available through
+// the AbstractFemSolver interface, whose virtual calls are made once per array, not per node.
+template <class Law>
+class DiffusionSolver : public FEMSolver {
+protected:
+    Law law;                // Diffusion law
+    double u_left = 1.0;    // Dirichlet value at x = 0
+    double u_right = 1.0;   // Dirichlet value at x = L
+    StiffnessMode stiffness_mode = StiffnessMode::Galerkin;  // Operator discretization
+    static constexpr int law_block = 64;  // Elements per call of a batch-evaluated law
+    TridiagonalMatrix laplacian;  // Constant Laplacian (D = 1) for the Kirchhoff mode
+    VectorXd phi;                 // Nodal Kirchhoff potential Phi(u), or D(u) for the Jacobian
+    unsigned laplacian_revision = ~0u;  // Mesh revision the Laplacian was assembled for
+
+    // Assemble the constant Laplacian once per mesh
+    void update_laplacian() {
+        if (laplacian_revision == mesh_revision) return;
+        if (laplacian.rows() != nx) {
+            laplacian = TridiagonalMatrix(nx);
+            phi.resize(nx);
+        }
+        work.d_elem.setOnes();
+        assemble_element_stiffness(work.d_elem, laplacian);
+        laplacian_revision = mesh_revision;
+    }
+
+    // Element quadrature for laws with batch evaluation: the quadrature-point values of u
+    // for a block of elements are gathered, the law is evaluated once for the whole block,
+    // and the weighted sums are reduced per element. dd_elem is filled when not null.
+    void element_diffusion_batched(const VectorXd& u_in, VectorXd& d_elem, MatrixX2d* dd_elem) {
+        constexpr int n_qp = ReferenceElement::n_qp;
+        parallel_range(nx - 1, [&](int begin, int end) {
+            double u_q[law_block * n_qp], D_q[law_block * n_qp], dD_q[law_block * n_qp];
+            for (int e0 = begin; e0 < end; e0 += law_block) {
+                const int m = min(law_block, end - e0);
+                for (int k = 0; k < m; ++k) {
+                    for (int q = 0; q < n_qp; ++q) {
+                        u_q[k * n_qp + q] = ReferenceElement::shape[q][0] * u_in[e0 + k]
+                                          + ReferenceElement::shape[q][1] * u_in[e0 + k + 1];
+                    }
+                }
+                law.evaluate(u_q, D_q, dd_elem ? dD_q : nullptr, m * n_qp);
+                for (int k = 0; k < m; ++k) {
+                    double d = 0.0, dd0 = 0.0, dd1 = 0.0;
+                    for (int q = 0; q < n_qp; ++q) {
+                        const double w = ReferenceElement::weight[q];
+                        d += w * D_q[k * n_qp + q];
+                        if (dd_elem) {
+                            const double dd = w * dD_q[k * n_qp + q];
+                            dd0 += dd * ReferenceElement::shape[q][0];
+                            dd1 += dd * ReferenceElement::shape[q][1];
+                        }
+                    }
+                    d_elem[e0 + k] = d;
+                    if (dd_elem) {
+                        (*dd_elem)(e0 + k, 0) = dd0;
+                        (*dd_elem)(e0 + k, 1) = dd1;
+                    }
+                }
+            }
+        });
+    }
+
+    void prepare_time_loop() override {
+        if (stiffness_mode == StiffnessMode::Kirchhoff) update_laplacian();
+    }
+
+    // In the Kirchhoff mode D only enters nodally (through A diag(D(u)) in the Jacobian), so
+    // the element average does not bound it; the larger nodal value of each element does
+    void element_diffusion_bound(const VectorXd& u_in, VectorXd& d_elem) override {
+        if (stiffness_mode != StiffnessMode::Kirchhoff) {
+            element_diffusion(u_in, d_elem);
+            return;
+        }
+        parallel_range(nx - 1, [&](int begin, int end) {
+            for (int e = begin; e < end; ++e) d_elem[e] = max(law.D(u_in[e]), law.D(u_in[e + 1]));
+        });
+    }
+
+public:
+    DiffusionSolver(int nx_, double L_, double dt_, int nt_, const Law& law_ = Law())
+        : FEMSolver(nx_, L_, dt_, nt_), law(law_) {}
 
     // Nonlinear diffusion coefficient as a function of u
-    double D(double u) {
-        return 1.0 + 0.5 * u;  // Example: linear dependence on u
+    double D(double u_) const { return law.D(u_); }
+
+    // Derivative of the diffusion coefficient dD/du
+    double dD(double u_) const { return law.dD(u_); }
+
+    void set_law(const Law& law_) { law = law_; }
+    const Law& get_law() const { return law; }
+
+    // Dirichlet values at x = 0 and x = L
+    void set_boundary_values(double left, double right) {
+        u_left = left;
+        u_right = right;
     }
 
-    // Override the stiffness matrix assembly specific to nonlinear diffusion
-    MatrixXd assemble_stiffness_matrix() override {
-        MatrixXd K = MatrixXd::Zero(nx, nx);
-        for (int i = 1; i < nx - 1; ++i) {
-            double diffusion_coeff = D(u[i]);  // Nonlinear diffusion coefficient
-            K(i, i) = 2 * diffusion_coeff / dx;  // Diagonal elements
-            K(i, i - 1) = -diffusion_coeff / dx;  // Off-diagonal elements
-            K(i - 1, i) = -diffusion_coeff / dx;  // Off-diagonal elements
+    // Select the operator discretization. The Kirchhoff mode writes the diffusion term as
+    // d^2 Phi(u) / dx^2 and needs a law with a closed-form potential Phi.
+    void set_stiffness_mode(StiffnessMode mode) {
+        if (mode == StiffnessMode::Kirchhoff && !has_kirchhoff_potential<Law>::value) {
+            throw invalid_argument("DiffusionSolver: the diffusion law has no Kirchhoff potential");
         }
-        K(0, 0) = 1.0;  // Dirichlet condition at x = 0
-        K(nx - 1, nx - 1) = 1.0;  // Dirichlet condition at x = L
+        stiffness_mode = mode;
+    }
+
+    // Element-averaged diffusion coefficient: D(u_h) integrated with the reference
+    // quadrature rule over each element, d_elem[e] = sum_q w_q D(u_h(xi_q)), in every mode
+    void element_diffusion(const VectorXd& u_in, VectorXd& d_elem) override {
+        if constexpr (has_batch_evaluation<Law>::value) {
+            element_diffusion_batched(u_in, d_elem, nullptr);
+            return;
+        }
+        parallel_range(nx - 1, [&](int begin, int end) {
+            for (int e = begin; e < end; ++e) {
+                double d = 0.0;
+                for (int q = 0; q < ReferenceElement::n_qp; ++q) {
+                    double u_q = ReferenceElement::shape[q][0] * u_in[e] + ReferenceElement::shape[q][1] * u_in[e + 1];
+                    d += ReferenceElement::weight[q] * law.D(u_q);
+                }
+                d_elem[e] = d;
+            }
+        });
+    }
+
+    // Element-averaged D together with its derivatives with respect to the element's
+    // nodal values, dd_elem(e, a) = sum_q w_q dD(u_h(xi_q)) N_a(xi_q)
+    void element_diffusion_derivative(const VectorXd& u_in, VectorXd& d_elem, MatrixX2d& dd_elem) {
+        if constexpr (has_batch_evaluation<Law>::value) {
+            element_diffusion_batched(u_in, d_elem, &dd_elem);
+            return;
+        }
+        parallel_range(nx - 1, [&](int begin, int end) {
+            for (int e = begin; e < end; ++e) {
+                double d = 0.0, dd0 = 0.0, dd1 = 0.0;
+                for (int q = 0; q < ReferenceElement::n_qp; ++q) {
+                    const double n0 = ReferenceElement::shape[q][0], n1 = ReferenceElement::shape[q][1];
+                    const double u_q = n0 * u_in[e] + n1 * u_in[e + 1];
+                    const double w = ReferenceElement::weight[q];
+                    d += w * law.D(u_q);
+                    const double dd = w * law.dD(u_q);
+                    dd0 += dd * n0;
+                    dd1 += dd * n1;
+                }
+                d_elem[e] = d;
+                dd_elem(e, 0) = dd0;
+                dd_elem(e, 1) = dd1;
+            }
+        });
+    }
+
+    // Override the stiffness matrix assembly specific to nonlinear diffusion (Galerkin element loop).
+    // This is always the Galerkin K(u): in the Kirchhoff mode the operator in use is A Phi(u),
+    // which has no matrix form K u, and K(u) u differs from it by the discretization error.
+    TridiagonalMatrix assemble_stiffness_matrix() override {
+        TridiagonalMatrix K(nx);
+        VectorXd d_elem(nx - 1);
+        element_diffusion(u, d_elem);
+        assemble_element_stiffness(d_elem, K);
         return K;
     }
 
+    // Matrix-free stiffness action K(u) * u: one pass over the quadrature points to
+    // evaluate D, one streaming pass over the nodes to apply the element stencils. In the
+    // Kirchhoff mode only the pointwise map Phi(u) remains, followed by the constant Laplacian.
+    void apply_stiffness(const VectorXd& u_in, VectorXd& Ku) override {
+        if constexpr (has_kirchhoff_potential<Law>::value) {
+            if (stiffness_mode == StiffnessMode::Kirchhoff) {
+                update_laplacian();
+                parallel_range(nx, [&](int begin, int end) {
+                    for (int i = begin; i < end; ++i) phi[i] = law.Phi(u_in[i]);
+                });
+                laplacian.multiply(phi, Ku);
+                return;
+            }
+        }
+        element_diffusion(u_in, work.d_elem);
+        apply_element_stiffness(work.d_elem, u_in, Ku);
+    }
+
+    // Jacobian of the stiffness action, used by the Newton iterations of implicit steps.
+    // In the Kirchhoff mode it is A diag(D(u)), since dPhi/du = D.
+    void apply_stiffness_jacobian(const VectorXd& u_in, TridiagonalMatrix& J) override {
+        if (stiffness_mode == StiffnessMode::Kirchhoff) {
+            update_laplacian();
+            parallel_range(nx, [&](int begin, int end) {
+                for (int i = begin; i < end; ++i) phi[i] = law.D(u_in[i]);
+            });
+            J.diag = laplacian.diag.cwiseProduct(phi);
+            J.lower.tail(nx - 1) = laplacian.lower.tail(nx - 1).cwiseProduct(phi.head(nx - 1));
+            J.upper.head(nx - 1) = laplacian.upper.head(nx - 1).cwiseProduct(phi.tail(nx - 1));
+            return;
+        }
+        element_diffusion_derivative(u_in, work.d_elem, work.dd_elem);
+        assemble_element_jacobian(work.d_elem, work.dd_elem, u_in, J);
+    }
+
     // Override boundary condition handling (Dirichlet BCs in this case)
     void apply_boundary_conditions(VectorXd& u_new) override {
-        u_new(0) = 1.0;     // Dirichlet condition at x = 0
-        u_new(nx - 1) = 1.0;  // Dirichlet condition at x = L
+        u_new(0) = u_left;     // Dirichlet condition at x = 0
+        u_new(nx - 1) = u_right;  // Dirichlet condition at x = L
+    }
+};
+
+// NonlinearDiffusionSolver: The reference problem, D(u) = 1 + 0.5 u with u = 1 at both ends
+class NonlinearDiffusionSolver : public DiffusionSolver<LinearDiffusion> {
+public:
+    NonlinearDiffusionSolver(int nx_, double L_, double dt_, int nt_)
+        : DiffusionSolver<LinearDiffusion>(nx_, L_, dt_, nt_) {}
+};
+
+// EnsembleDiffusionSolver: Advances N independent nonlinear diffusion problems on one mesh
+// together. Member m has D_m(u) = a_m + b_m u, its own Dirichlet values and initial data.
+// Fields are stored interleaved (an N x nx column-major matrix, member index fastest), so
+// every quadrature, stencil and tridiagonal sweep runs across the members in its inner loop.
+// Forward Euler is sub-cycled to the stability limit; the theta schemes solve the per-member
+// Newton systems with one batched tridiagonal factorization per iteration.
+class EnsembleDiffusionSolver {
+    int n_members;  // Number of ensemble members N
+    int nx;         // Number of nodes
+    double L;       // Length of domain
+    double dx;      // Spatial step size
+    double dt;      // Time step size
+    int nt;         // Number of time steps
+    MatrixXd U;     // Solutions, U(m, i) = u_m(x_i)
+    ArrayXd d_const, d_slope;   // Diffusion law coefficients a_m, b_m
+    ArrayXd u_left, u_right;    // Dirichlet values at x = 0 and x = L
+    MassMatrixType mass_type = MassMatrixType::Consistent;
+    TimeIntegrator integrator = TimeIntegrator::ForwardEuler;
+    double theta = 0.5;         // Implicitness of TimeIntegrator::Theta
+    double newton_tol = 1e-10;  // Newton tolerance on the max-norm of the update
+    int newton_max_iter = 20;   // Newton iteration limit per implicit step
+    double stability_safety = 0.9;  // Fraction of the estimated forward Euler limit used per sub-step
+    TridiagonalMatrix M;        // Mass matrix shared by all members
+    TridiagonalLU M_lu;         // Its factorization
+    MatrixXd D_elem;            // Element-averaged D, D_elem(m, e)
+    MatrixXd KU;                // Stiffness action per member
+    MatrixXd KU_old;            // Explicit part of the theta scheme
+    MatrixXd U_new;             // Solutions at the next time level (Newton iterate)
+    MatrixXd R;                 // Newton residuals, overwritten by the updates
+    MatrixXd W;                 // Scratch for U_new - U
+    MatrixXd JL, JD, JU;        // Newton Jacobians of all members (sub-, main, super-diagonal)
+    BatchedTridiagonalLU J_lu;  // Their batched factorization
+
+    void assemble_mass_matrix() {
+        fe_mass_matrix(VectorXd::Constant(nx - 1, dx), mass_type, M);
+        M_lu.compute(M);
+    }
+
+    // Y = M X for every member
+    void multiply_mass(const MatrixXd& X, MatrixXd& Y) const {
+        Y.col(0) = M.diag(0) * X.col(0) + M.upper(0) * X.col(1);
+        for (int i = 1; i < nx - 1; ++i) {
+            Y.col(i) = M.lower(i) * X.col(i - 1) + M.diag(i) * X.col(i) + M.upper(i) * X.col(i + 1);
+        }
+        Y.col(nx - 1) = M.lower(nx - 1) * X.col(nx - 2) + M.diag(nx - 1) * X.col(nx - 1);
+    }
+
+    // D at the quadrature points of every element, averaged, for all members at once
+    void element_diffusion(const MatrixXd& V) {
+        for (int e = 0; e < nx - 1; ++e) {
+            D_elem.col(e).array() = d_const;
+            for (int q = 0; q < ReferenceElement::n_qp; ++q) {
+                D_elem.col(e).array() += ReferenceElement::weight[q] * d_slope
+                    * (ReferenceElement::shape[q][0] * V.col(e).array() + ReferenceElement::shape[q][1] * V.col(e + 1).array());
+            }
+        }
+    }
+
+    // KV = K(v_m) v_m for every member from the current D_elem, gathered node by node
+    void apply_stiffness(const MatrixXd& V, MatrixXd& KV) const {
+        const double inv_dx = 1.0 / dx;
+        KV.col(0).setZero();
+        for (int i = 1; i < nx - 1; ++i) {
+            KV.col(i).array() = (D_elem.col(i - 1).array()
+                                     * (ReferenceElement::s10 * V.col(i - 1).array() + ReferenceElement::s11 * V.col(i).array())
+                               + D_elem.col(i).array()
+                                     * (ReferenceElement::s00 * V.col(i).array() + ReferenceElement::s01 * V.col(i + 1).array())) * inv_dx;
+        }
+        KV.col(nx - 1).setZero();
+    }
+
+    // Newton Jacobians M + c d(K(v) v)/dv of all members from the current D_elem; with
+    // D linear in u, dD/du = b_m and the quadrature of dD N_a gives b_m / 2 per node
+    void assemble_jacobians(const MatrixXd& V, double c) {
+        constexpr double g0 = ReferenceElement::weight[0] * ReferenceElement::shape[0][0]
+                            + ReferenceElement::weight[1] * ReferenceElement::shape[1][0];
+        constexpr double g1 = ReferenceElement::weight[0] * ReferenceElement::shape[0][1]
+                            + ReferenceElement::weight[1] * ReferenceElement::shape[1][1];
+        const double inv_dx = 1.0 / dx;
+        for (int i = 0; i < nx; ++i) {
+            JL.col(i).setConstant(M.lower(i));
+            JD.col(i).setConstant(M.diag(i));
+            JU.col(i).setConstant(M.upper(i));
+        }
+        for (int e = 0; e < nx - 1; ++e) {
+            auto k = c * inv_dx * D_elem.col(e).array();
+            auto flux = c * inv_dx * (V.col(e + 1).array() - V.col(e).array()) * d_slope;
+            if (e > 0) {
+                JD.col(e).array() += k * ReferenceElement::s00 - flux * g0;
+                JU.col(e).array() += k * ReferenceElement::s01 - flux * g1;
+            }
+            if (e + 1 < nx - 1) {
+                JL.col(e + 1).array() += k * ReferenceElement::s10 + flux * g0;
+                JD.col(e + 1).array() += k * ReferenceElement::s11 + flux * g1;
+            }
+        }
+    }
+
+    // Largest stable forward Euler step over all members (Gershgorin, as in FEMSolver)
+    double stable_time_step() const {
+        const double rho = gershgorin_spectral_radius(M, mass_type, [&](int i) {
+            return 2.0 * (D_elem.col(i - 1).array() + D_elem.col(i).array()).maxCoeff() / dx;
+        });
+        return stable_step_size(rho, stability_safety);
+    }
+
+    // Forward Euler step of size h for all members, D_elem evaluated at U
+    void step_forward_euler(double h) {
+        apply_stiffness(U, KU);
+        if (mass_type == MassMatrixType::Lumped) {
+            for (int i = 0; i < nx; ++i) {
+                U_new.col(i) = U.col(i) - (h / M.diag(i)) * KU.col(i);
+            }
+        } else {
+            multiply_mass(U, U_new);
+            U_new -= h * KU;
+            M_lu.solve_batch(U_new);
+        }
+    }
+
+    // Theta-scheme step of size h for all members: Newton on
+    // M (v - u) + h [th K(v) v + (1 - th) K(u) u] = 0, iterated until every member converged
+    void step_theta(double h, double th) {
+        if (th < 1.0) {
+            element_diffusion(U);
+            apply_stiffness(U, KU_old);
+            KU_old *= (1.0 - th) * h;
+        } else {
+            KU_old.setZero();
+        }
+        U_new = U;
+        for (int it = 0; it < newton_max_iter; ++it) {
+            W = U_new - U;
+            multiply_mass(W, R);
+            element_diffusion(U_new);
+            apply_stiffness(U_new, KU);
+            R += th * h * KU + KU_old;
+            assemble_jacobians(U_new, th * h);
+            J_lu.compute(JL, JD, JU);
+            J_lu.solve(R);
+            U_new -= R;
+            if (R.lpNorm<Infinity>() <= newton_tol * (1.0 + U_new.lpNorm<Infinity>())) return;
+        }
+        throw runtime_error("EnsembleDiffusionSolver: Newton iteration did not converge");
+    }
+
+    void apply_boundary_conditions(MatrixXd& V) const {
+        V.col(0) = u_left.matrix();
+        V.col(nx - 1) = u_right.matrix();
+    }
+
+    void check_member(int m) const {
+        if (m < 0 || m >= n_members) throw invalid_argument("EnsembleDiffusionSolver: member index out of range");
+    }
+
+public:
+    // All members start as copies of NonlinearDiffusionSolver: D(u) = 1 + 0.5 u, u = 1
+    EnsembleDiffusionSolver(int n_members_, int nx_, double L_, double dt_, int nt_)
+        : n_members(n_members_), nx(nx_), L(L_), dt(dt_), nt(nt_) {
+        if (n_members < 1) throw invalid_argument("EnsembleDiffusionSolver: need at least one member");
+        if (nx < 3) throw invalid_argument("EnsembleDiffusionSolver: a mesh needs at least three nodes");
+        dx = L / (nx - 1);
+        U = MatrixXd::Ones(n_members, nx);
+        d_const = ArrayXd::Constant(n_members, 1.0);
+        d_slope = ArrayXd::Constant(n_members, 0.5);
+        u_left = ArrayXd::Ones(n_members);
+        u_right = ArrayXd::Ones(n_members);
+        D_elem.resize(n_members, nx - 1);
+        KU.resize(n_members, nx);
+        KU_old.resize(n_members, nx);
+        U_new.resize(n_members, nx);
+        R.resize(n_members, nx);
+        W.resize(n_members, nx);
+        JL.resize(n_members, nx);
+        JD.resize(n_members, nx);
+        JU.resize(n_members, nx);
+        J_lu.resize(n_members, nx);
+        assemble_mass_matrix();
+    }
+
+    // Configure member m: diffusion law a + b u, boundary values and initial data
+    void set_member(int m, double a, double b, double left, double right, const VectorXd& u0) {
+        check_member(m);
+        if (u0.size() != nx) throw invalid_argument("EnsembleDiffusionSolver: initial data must have nx values");
+        d_const(m) = a;
+        d_slope(m) = b;
+        u_left(m) = left;
+        u_right(m) = right;
+        U.row(m) = u0.transpose();
+        U(m, 0) = left;
+        U(m, nx - 1) = right;
+    }
+
+    void set_mass_matrix_type(MassMatrixType type) {
+        mass_type = type;
+        assemble_mass_matrix();
+    }
+
+    // ForwardEuler, BackwardEuler, CrankNicolson or Theta (RKC is not available for ensembles)
+    void set_time_integrator(TimeIntegrator integrator_) {
+        if (integrator_ == TimeIntegrator::RKC) {
+            throw invalid_argument("EnsembleDiffusionSolver: RKC is not supported");
+        }
+        integrator = integrator_;
+    }
+
+    // Weight of the new time level for TimeIntegrator::Theta, in [0, 1]
+    void set_theta(double theta_) {
+        if (theta_ < 0.0 || theta_ > 1.0) throw invalid_argument("EnsembleDiffusionSolver: theta must lie in [0, 1]");
+        theta = theta_;
+    }
+
+    // Fraction of the estimated stability limit used by the forward Euler sub-steps, in (0, 1]
+    void set_stability_safety(double safety) {
+        if (!(safety > 0.0 && safety <= 1.0)) {
+            throw invalid_argument("EnsembleDiffusionSolver: stability safety must lie in (0, 1]");
+        }
+        stability_safety = safety;
+    }
+
+    // Advance all members nt steps of size dt
+    void solve() {
+        NoMallocScope no_malloc(true);
+        for (int n = 0; n < nt; ++n) {
+            if (integrator != TimeIntegrator::ForwardEuler) {
+                double th = integrator == TimeIntegrator::BackwardEuler ? 1.0
+                          : integrator == TimeIntegrator::CrankNicolson ? 0.5 : theta;
+                step_theta(dt, th);
+                apply_boundary_conditions(U_new);
+                U.swap(U_new);
+                continue;
+            }
+            element_diffusion(U);
+            const double h_stable = stable_time_step();
+            const int substeps = dt > h_stable ? static_cast<int>(ceil(dt / h_stable)) : 1;
+            for (int k = 0; k < substeps; ++k) {
+                if (k > 0) element_diffusion(U);
+                step_forward_euler(dt / substeps);
+                apply_boundary_conditions(U_new);
+                U.swap(U_new);
+            }
+        }
+    }
+
+    VectorXd solution(int m) const {
+        check_member(m);
+        return U.row(m).transpose();
+    }
+
+    // Display the solution of member m
+    void display_solution(int m) const {
+        check_member(m);
+        for (int i = 0; i < nx; ++i) {
+            cout << "x[" << i << "] = " << i * dx << ", u" << m << "[" << i << "] = " << U(m, i) << endl;
+        }
     }
 };
 
-int main() {
-    // Create an instance of NonlinearDiffusionSolver with nx=20, L=2, dt=0.001, nt=100
-    AbstractFemSolver* solver = new NonlinearDiffusionSolver(20, 2.0, 0.001, 100);
+// Define FEM_NO_MAIN to include this file into another program (see alloc_check.cpp)
+#ifndef FEM_NO_MAIN
+int main(int argc, char** argv) {
+    // Optional physics from the command line:
+    //   --diffusion "D = 1 + 0.5*u + 0.1*u^2"   diffusion law as a formula
+    //   --plugin ./physics.so                   diffusion law and/or source term from a plugin
+    string formula, plugin_path;
+    for (int i = 1; i < argc; i += 2) {
+        const string option = argv[i];
+        if (i + 1 < argc && option == "--diffusion") {
+            formula = argv[i + 1];
+        } else if (i + 1 < argc && option == "--plugin") {
+            plugin_path = argv[i + 1];
+        } else {
+            cerr << "usage: " << argv[0] << " [--diffusion \"D = <expression in u>\"] [--plugin <library.so>]" << endl;
+            return 1;
+        }
+    }
+
+    PluginLibrary plugin;  // Declared first: must outlive the solver
+    FEMSolver* solver = nullptr;
+    try {
+        if (!plugin_path.empty()) plugin.open(plugin_path);
+        if (!formula.empty()) {
+            solver = new DiffusionSolver<ExpressionDiffusion>(20, 2.0, 0.001, 100, ExpressionDiffusion(formula));
+        } else if (plugin.has_diffusion()) {
+            solver = new DiffusionSolver<PluginDiffusion>(20, 2.0, 0.001, 100, PluginDiffusion(plugin));
+        } else {
+            // Create an instance of NonlinearDiffusionSolver with nx=20, L=2, dt=0.001, nt=100
+            solver = new NonlinearDiffusionSolver(20, 2.0, 0.001, 100);
+        }
+        solver->set_source(plugin.source_term());
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        delete solver;
+        return 1;
+    }
     
     // Solve the nonlinear diffusion equation
     solver->solve();
@@ -130,3 +2722,4 @@ int main() {
     delete solver;
     return 0;
 }
+#endif  // FEM_NO_MAIN